@@ -0,0 +1,145 @@
+// agents/flash-mailbox.c
+//
+// Copyright 2015 Brian Swetland <swetland@frotz.net>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Included by agents that set FLAG_STREAM or FLAG_SERVICE, after
+// their erase and write methods, a flash_agent_read() that reads
+// count words of flash starting at addr, and a flash_regions[] table
+// and FLASH_WRITE_SIZE describing their flash.  FLASH_GEOM_FLAGS may
+// add GEOM_* flags.
+
+#ifndef FLASH_GEOM_FLAGS
+#define FLASH_GEOM_FLAGS	0
+#endif
+
+// in .data so that it is part of the downloaded image
+volatile flash_mailbox __attribute((section(".data"))) Mailbox;
+
+static int flash_agent_stream(u32 flash_addr, char *data, u32 length) {
+	volatile flash_mailbox *mb = &Mailbox;
+	u32 chunk = mb->chunk;
+	u32 n = 0;
+	u32 xfer;
+	int r;
+
+	while (length > 0) {
+		xfer = (length > chunk) ? chunk : length;
+		while (mb->posted == n) ;
+		// don't let the compiler read the buffer before it's posted
+		__asm__ volatile ("" ::: "memory");
+		r = flash_agent_write(flash_addr, data + (n & 1) * chunk, xfer);
+		if (r != ERR_NONE) {
+			mb->done = STREAM_FAILED;
+			return r;
+		}
+		mb->done = ++n;
+		flash_addr += xfer;
+		length -= xfer;
+	}
+	return ERR_NONE;
+}
+
+static int flash_agent_service(void) {
+	volatile flash_mailbox *mb = &Mailbox;
+	u32 cmd;
+	int r;
+
+	for (;;) {
+		while ((cmd = mb->cmd) == 0) ;
+		__asm__ volatile ("" ::: "memory");
+		switch (cmd) {
+		case SVC_ERASE:
+			r = flash_agent_erase(mb->arg[0], mb->arg[1]);
+			break;
+		case SVC_WRITE:
+			r = flash_agent_write(mb->arg[0], (void*) mb->arg[1], mb->arg[2]);
+			break;
+		case SVC_IOCTL:
+			r = flash_agent_ioctl(mb->arg[0], (void*) mb->arg[1],
+				mb->arg[2], mb->arg[3]);
+			break;
+		case SVC_EXIT:
+			mb->status = ERR_NONE;
+			mb->cmd = 0;
+			return ERR_NONE;
+		default:
+			r = ERR_INVALID;
+		}
+		mb->status = r;
+		mb->cmd = 0;
+	}
+}
+
+static int flash_agent_crc32(u32 *table, u32 count) {
+	u32 buf[16];
+	u32 addr, length, xfer, crc;
+	int n, b;
+
+	while (count-- > 0) {
+		addr = table[0];
+		length = table[1];
+		if ((addr & 3) || (length & 3)) {
+			return ERR_ALIGNMENT;
+		}
+		crc = 0xFFFFFFFF;
+		while (length > 0) {
+			xfer = (length > sizeof(buf)) ? sizeof(buf) : length;
+			if (flash_agent_read(addr, buf, xfer / 4)) {
+				return ERR_FAIL;
+			}
+			for (n = 0; n < xfer; n++) {
+				crc ^= ((unsigned char*) buf)[n];
+				for (b = 0; b < 8; b++) {
+					crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+				}
+			}
+			addr += xfer;
+			length -= xfer;
+		}
+		table[2] = ~crc;
+		table += 3;
+	}
+	return ERR_NONE;
+}
+
+static int flash_agent_geometry(flash_geometry *g, u32 max) {
+	u32 n, count = sizeof(flash_regions) / sizeof(flash_regions[0]);
+
+	g->write_size = FLASH_WRITE_SIZE;
+	g->count = count;
+	g->flags = FLASH_GEOM_FLAGS;
+	for (n = 0; (n < count) && (n < max); n++) {
+		// field by field, so gcc doesn't reach for memcpy()
+		g->region[n].base = flash_regions[n].base;
+		g->region[n].sector_size = flash_regions[n].sector_size;
+		g->region[n].count = flash_regions[n].count;
+	}
+	return ERR_NONE;
+}
+
+int flash_mailbox_ioctl(u32 op, void *ptr, u32 arg0, u32 arg1) {
+	switch (op) {
+	case IOCTL_STREAM_WRITE:
+		return flash_agent_stream(arg0, ptr, arg1);
+	case IOCTL_SERVICE:
+		return flash_agent_service();
+	case IOCTL_CRC32:
+		return flash_agent_crc32(ptr, arg0);
+	case IOCTL_GEOMETRY:
+		return flash_agent_geometry(ptr, arg0);
+	default:
+		return ERR_INVALID;
+	}
+}
@@ -206,19 +206,42 @@ int flash_agent_write(u32 flash_addr, const void *data, u32 length) {
 	return ERR_NONE;
 }
 
+static const flash_region flash_regions[] = {
+	{ FLASH_BASE, 0x1000, FLASH_SIZE / 0x1000 },
+};
+
+// writes are padded to 256 byte pages, but must start on a sector
+#define FLASH_WRITE_SIZE	0x1000
+
+static int flash_agent_read(u32 addr, u32 *data, u32 count) {
+	writel(addr, SPIFI_ADDR);
+	writel(CMD_DATALEN(count * 4) | CMD_FF_SERIAL | CMD_FR_OP_3B |
+		CMD_OPCODE(CMD_READ_DATA), SPIFI_CMD);
+	while (count-- > 0) {
+		*data++ = readl(SPIFI_DATA);
+	}
+	while (readl(SPIFI_STAT) & STAT_CMD) ;
+	writel(CMD_FF_SERIAL | CMD_FR_OP_3B | CMD_OPCODE(CMD_READ_DATA), SPIFI_MCMD);
+	return ERR_NONE;
+}
+
+#include "flash-mailbox.c"
+
 int flash_agent_ioctl(u32 op, void *ptr, u32 arg0, u32 arg1) {
-	return ERR_INVALID;
+	return flash_mailbox_ioctl(op, ptr, arg0, arg1);
 }
 
 const flash_agent __attribute((section(".vectors"))) FlashAgent = {
 	.magic =	AGENT_MAGIC,
 	.version =	AGENT_VERSION,
-	.flags =	0,
+	.flags =	FLAG_STREAM | FLAG_SERVICE,
 	.load_addr =	LOADADDR,
 	.data_addr =	LOADADDR + 0x400,
 	.data_size =	0x8000,
 	.flash_addr =	FLASH_BASE,
 	.flash_size =	FLASH_SIZE,
+	.mailbox =	&Mailbox,
+	.sector_size =	0x1000,
 	.setup =	flash_agent_setup,
 	.erase =	flash_agent_erase,
 	.write =	flash_agent_write,
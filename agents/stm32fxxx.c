@@ -80,6 +80,17 @@ int flash_agent_setup(flash_agent *agent) {
 int flash_agent_erase(u32 flash_addr, u32 length) {
 	u32 v;
 	int n;
+	if ((flash_addr == FLASH_BASE) && (length >= FLASH_SIZE)) {
+		// one mass erase beats a dozen sector erases
+		writel(FLASH_CR_MER, FLASH_CR);
+		writel(FLASH_CR_STRT | FLASH_CR_MER, FLASH_CR);
+		while ((v = readl(FLASH_SR)) & FLASH_SR_BSY) ;
+		writel(0, FLASH_CR);
+		if (v & FLASH_SR_ERRMASK) {
+			return ERR_FAIL;
+		}
+		return ERR_NONE;
+	}
 	for (n = 0; n < SECTORS; n++) {
 		if (flash_addr == sectors[n]) goto ok;
 	}
@@ -121,19 +132,42 @@ int flash_agent_write(u32 flash_addr, const void *_data, u32 length) {
 	return ERR_NONE;
 }
 
+// the sectors[] table, as regions
+static const flash_region flash_regions[] = {
+	{ 0x00000000, 0x4000, 4 },
+	{ 0x00010000, 0x10000, 1 },
+	{ 0x00020000, 0x20000, 7 },
+};
+
+// PSIZE_32 programming
+#define FLASH_WRITE_SIZE	4
+
+#define FLASH_GEOM_FLAGS	GEOM_MASS_ERASE
+
+static int flash_agent_read(u32 addr, u32 *data, u32 count) {
+	while (count-- > 0) {
+		*data++ = readl(addr);
+		addr += 4;
+	}
+	return ERR_NONE;
+}
+
+#include "flash-mailbox.c"
+
 int flash_agent_ioctl(u32 op, void *ptr, u32 arg0, u32 arg1) {
-	return ERR_INVALID;
+	return flash_mailbox_ioctl(op, ptr, arg0, arg1);
 }
 
 const flash_agent __attribute((section(".vectors"))) FlashAgent = {
 	.magic =	AGENT_MAGIC,
 	.version =	AGENT_VERSION,
-	.flags =	0,
+	.flags =	FLAG_STREAM | FLAG_SERVICE,
 	.load_addr =	LOADADDR,
 	.data_addr =	LOADADDR + 0x400,
 	.data_size =	0x8000,
 	.flash_addr =	FLASH_BASE,
 	.flash_size =	FLASH_SIZE,
+	.mailbox =	&Mailbox,
 	.setup =	flash_agent_setup,
 	.erase =	flash_agent_erase,
 	.write =	flash_agent_write,
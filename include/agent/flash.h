@@ -33,8 +33,12 @@ typedef struct flash_agent {
 	u32 flash_addr;
 	u32 flash_size; // bytes
 
-	u32 reserved0;
-	u32 reserved1;
+#ifdef _AGENT_HOST_
+	u32 mailbox;
+#else
+	volatile struct flash_mailbox *mailbox;
+#endif
+	u32 sector_size; // bytes, if erase sectors are uniform, else 0
 	u32 reserved2;
 	u32 reserved3;
 
@@ -51,6 +55,41 @@ typedef struct flash_agent {
 #endif
 } flash_agent;
 
+// Shared with the host while the agent runs, for FLAG_STREAM
+// and FLAG_SERVICE
+typedef struct flash_mailbox {
+	u32 chunk;	// host: bytes per half of the data buffer
+	u32 posted;	// host: chunks downloaded so far
+	u32 done;	// agent: chunks written so far
+	u32 reserved;
+	u32 arg[4];	// host: arguments of the next command
+	u32 cmd;	// host: SVC_* to run, agent: 0 once it has run
+	u32 status;	// agent: result of the last command
+} flash_mailbox;
+
+#define STREAM_FAILED	0xFFFFFFFF // in done, if a write failed
+
+#define SVC_ERASE	1 // erase(arg[0], arg[1])
+#define SVC_WRITE	2 // write(arg[0], arg[1], arg[2])
+#define SVC_IOCTL	3 // ioctl(arg[0], arg[1], arg[2], arg[3])
+#define SVC_EXIT	4 // return from IOCTL_SERVICE
+
+// Filled in by IOCTL_GEOMETRY
+typedef struct flash_region {
+	u32 base;
+	u32 sector_size; // bytes
+	u32 count;	// sectors
+} flash_region;
+
+typedef struct flash_geometry {
+	u32 write_size;	// bytes per write block
+	u32 count;	// regions, which may be more than were room for
+	u32 flags;	// GEOM_*
+	flash_region region[];
+} flash_geometry;
+
+#define GEOM_MASS_ERASE	1 // erasing all of flash is one mass erase
+
 #ifndef _AGENT_HOST_
 int flash_agent_setup(flash_agent *agent);
 int flash_agent_erase(u32 flash_addr, u32 length);
@@ -63,12 +102,23 @@ int flash_agent_ioctl(u32 op, void *ptr, u32 arg0, u32 arg1);
 #define ERR_INVALID	-2
 #define ERR_ALIGNMENT	-3
 
+#define IOCTL_STREAM_WRITE	1
+// ioctl(IOCTL_STREAM_WRITE, data, flash_addr, length)
+#define IOCTL_SERVICE		2
+// ioctl(IOCTL_SERVICE, 0, 0, 0)
+#define IOCTL_CRC32		3
+// ioctl(IOCTL_CRC32, table, count, 0)
+#define IOCTL_GEOMETRY		4
+// ioctl(IOCTL_GEOMETRY, geometry, max_regions, 0)
+
 #define FLAG_WSZ_256B		0x00000100
 #define FLAG_WSZ_512B		0x00000200
 #define FLAG_WSZ_1K		0x00000400
 #define FLAG_WSZ_2K		0x00000800
 #define FLAG_WSZ_4K		0x00001000
+#define FLAG_WSZ_MASK		0x00001F00
 // optional hints as to underlying write block sizes
+// (IOCTL_GEOMETRY reports the exact size)
 
 #define FLAG_BOOT_ROM_HACK	0x00000001
 // Allow a boot ROM to run after RESET by setting a watchpoint
@@ -76,6 +126,12 @@ int flash_agent_ioctl(u32 op, void *ptr, u32 arg0, u32 arg1);
 // some parts which require boot ROM initialization of Flash
 // timing registers, etc.
 
+#define FLAG_STREAM		0x00000002
+// The agent supports IOCTL_STREAM_WRITE and fa.mailbox is valid.
+
+#define FLAG_SERVICE		0x00000004
+// The agent supports IOCTL_SERVICE and fa.mailbox is valid.
+
 
 // Flash agent binaries will be downloaded to device memory at
 // fa.load_addr.  The memory below this address will be used as
@@ -124,14 +180,46 @@ int flash_agent_ioctl(u32 op, void *ptr, u32 arg0, u32 arg1);
 // possible.
 //
 // fa.ioctl() must return ERR_INVALID if op is unsupported.
-// Currently no ops are defined, but OTP/EEPROM/Config bits are
-// planned to be managed with ioctls.
+// OTP/EEPROM/Config bits are planned to be managed with ioctls.
+//
+// IOCTL_STREAM_WRITE writes length bytes at flash_addr from a data
+// buffer split in two halves of mailbox.chunk bytes, without halting
+// between chunks.  The host fills the halves alternately, bumping
+// mailbox.posted after each, and the agent bumps mailbox.done after
+// writing each, so the next chunk downloads while this one programs.
+// The host never refills a half until the chunk in it is done.  If a
+// write fails, done is set to STREAM_FAILED and the ioctl returns.
+// Agents with FLAG_STREAM must accept data_size / 2 as a write size.
+//
+// IOCTL_SERVICE runs the other methods on request until told to stop,
+// so that the host need not set up registers, resume, and wait for a
+// halt for each call.  The host writes mailbox.arg[] and then
+// mailbox.cmd (in one ascending block write), and the agent stores the
+// result in mailbox.status before clearing mailbox.cmd.  SVC_EXIT makes
+// the ioctl return ERR_NONE.
+//
+// IOCTL_CRC32 takes a table of count { addr, length, crc } entries
+// and fills in the crc (CRC-32, as zlib computes it) of each range of
+// flash.  Addresses and lengths must be multiples of 4.  The host uses
+// it to skip erasing and writing sectors that already hold the image.
+//
+// fa.sector_size, if not 0, says flash is erased in sectors of that
+// many bytes starting at fa.flash_addr, which lets the host find them.
+//
+// IOCTL_GEOMETRY describes flash as regions of equal sized erase
+// sectors, in address order, plus the write block size.  The host
+// uses it to erase exactly the sectors a write touches, to erase the
+// whole part with erase(fa.flash_addr, fa.flash_size) when every
+// sector is to be erased anyway, and to size downloads to whole write
+// blocks.  GEOM_MASS_ERASE says the agent does such an erase with a
+// single mass erase rather than sector by sector.  Agents without
+// IOCTL_GEOMETRY fall back to fa.sector_size and FLAG_WSZ_*.
 //
 // Bogus parameters may cause failure (ERR_INVALID)
 //
-// * In general, conveying the full complexity of embedded flash
-// configuration (which could include various banks of various sizes,
-// with differing write and erase block size requirements) is not
+// * Beyond IOCTL_GEOMETRY, conveying the full complexity of embedded
+// flash configuration (which could include various banks with
+// differing write and erase block size requirements) is not
 // attempted.  The goal is to provide an agent that can reasonably
 // handle reasonable flash requests (eg the user knows what a sane
 // starting alignment, etc is, does not split logical "partitions"
@@ -35,39 +35,178 @@ void swdp_interrupt(void) {
 }
 
 
-int swdp_core_write(u32 n, u32 v) {
-	if (mem_wr_32(CDBG_REG_DATA, v)) {
-		return -1;
+// Register values are cached while the core is halted.  Entries are
+// only filled when the DHCSR read in the same batch shows S_HALT, and
+// everything is dropped when the core may have run (resume, step,
+// reset, attach, or a raw write to the debug control registers).
+static u32 regcache[32];
+static u32 regcache_valid = 0;
+static unsigned regcache_hits = 0;
+static unsigned regcache_misses = 0;
+
+void swdp_core_cache_invalidate(void) {
+	regcache_valid = 0;
+}
+
+void swdp_core_cache_stats(unsigned *hits, unsigned *misses, u32 *valid) {
+	*hits = regcache_hits;
+	*misses = regcache_misses;
+	*valid = regcache_valid;
+}
+
+void swdp_core_cache_reset_stats(void) {
+	regcache_hits = 0;
+	regcache_misses = 0;
+}
+
+void swdp_core_cache_check_write(u32 addr, u32 len, u32 value) {
+	// a reset through AIRCR changes every register
+	if ((addr <= AIRCR) && ((addr + len) > AIRCR)) {
+		regcache_valid = 0;
+		return;
 	}
-	if (mem_wr_32(CDBG_REG_ADDR, (n & 0x1F) | 0x10000)) {
-		return -1;
+	if ((addr > CDBG_REG_DATA) || ((addr + len) <= CDBG_CSR)) {
+		return;
 	}
-	return 0;
+	// a DHCSR write that keeps the core halted is harmless
+	if ((addr == CDBG_CSR) && (len == 4) && (value & CDBG_C_HALT)) {
+		return;
+	}
+	regcache_valid = 0;
 }
 
-int swdp_core_read(u32 n, u32 *v) {
-	if (mem_wr_32(CDBG_REG_ADDR, n & 0x1F)) {
-		return -1;
+// slow path for when a register transfer is not done by the
+// time the batched DHCSR read samples S_REGRDY
+static int swdp_core_wait_regrdy(void) {
+	unsigned n;
+	u32 csr;
+	for (n = 0; n < 100; n++) {
+		if (mem_rd_32(CDBG_CSR, &csr)) {
+			return -1;
+		}
+		if (csr & CDBG_S_REGRDY) {
+			return 0;
+		}
 	}
-	if (mem_rd_32(CDBG_REG_DATA, v)) {
-		return -1;
+	xprintf(XCORE, "core: register transfer timed out\n");
+	return -1;
+}
+
+int swdp_core_read_regs(u32 mask, u32 *v) {
+	debug_batch b;
+	u32 csr[32];
+	unsigned n;
+
+	for (n = 0; n < 32; n++) {
+		if (mask & regcache_valid & (1u << n)) {
+			v[n] = regcache[n];
+			mask &= ~(1u << n);
+			regcache_hits++;
+		}
+	}
+	if (mask == 0) {
+		return 0;
+	}
+
+	debug_batch_init(&b);
+	for (n = 0; n < 32; n++) {
+		if (mask & (1u << n)) {
+			regcache_misses++;
+			debug_batch_wr_32(&b, CDBG_REG_ADDR, n);
+			debug_batch_rd_32(&b, CDBG_CSR, csr + n);
+			debug_batch_rd_32(&b, CDBG_REG_DATA, v + n);
+		}
+	}
+	if (debug_batch_commit(&b)) {
+		goto fail;
+	}
+	for (n = 0; n < 32; n++) {
+		if (!(mask & (1u << n))) {
+			continue;
+		}
+		if (!(csr[n] & CDBG_S_REGRDY)) {
+			if (mem_wr_32(CDBG_REG_ADDR, n)) goto fail;
+			if (swdp_core_wait_regrdy()) goto fail;
+			if (mem_rd_32(CDBG_REG_DATA, v + n)) goto fail;
+		}
+		if (csr[n] & CDBG_S_HALT) {
+			regcache[n] = v[n];
+			regcache_valid |= (1u << n);
+		}
 	}
 	return 0;
+fail:
+	regcache_valid = 0;
+	return -1;
 }
 
-int swdp_core_read_all(u32 *v) {
+int swdp_core_write_regs(u32 mask, u32 *v) {
+	debug_batch b;
+	u32 csr[32];
 	unsigned n;
-	for (n = 0; n < 19; n++) {
-		if (mem_wr_32(CDBG_REG_ADDR, n & 0x1F)) {
-			return -1;
+
+	debug_batch_init(&b);
+	for (n = 0; n < 32; n++) {
+		if (mask & (1u << n)) {
+			debug_batch_wr_32(&b, CDBG_REG_DATA, v[n]);
+			debug_batch_wr_32(&b, CDBG_REG_ADDR, n | 0x10000);
+			debug_batch_rd_32(&b, CDBG_CSR, csr + n);
 		}
-		if (mem_rd_32(CDBG_REG_DATA, v++)) {
-			return -1;
+	}
+	if (debug_batch_commit(&b)) {
+		goto fail;
+	}
+	// if a transfer was still busy when the next one was queued,
+	// redo everything from that point on, one at a time
+	for (n = 0; n < 32; n++) {
+		if ((mask & (1u << n)) && !(csr[n] & CDBG_S_REGRDY)) {
+			break;
+		}
+	}
+	for (; n < 32; n++) {
+		if (mask & (1u << n)) {
+			if (mem_wr_32(CDBG_REG_DATA, v[n])) goto fail;
+			if (mem_wr_32(CDBG_REG_ADDR, n | 0x10000)) goto fail;
+			if (swdp_core_wait_regrdy()) goto fail;
 		}
 	}
+	for (n = 0; n < 32; n++) {
+		if (mask & (1u << n)) {
+			if (csr[n] & CDBG_S_HALT) {
+				regcache[n] = v[n];
+				regcache_valid |= (1u << n);
+			} else {
+				regcache_valid &= ~(1u << n);
+			}
+		}
+	}
+	return 0;
+fail:
+	regcache_valid = 0;
+	return -1;
+}
+
+int swdp_core_write(u32 n, u32 v) {
+	u32 regs[32];
+	n &= 0x1F;
+	regs[n] = v;
+	return swdp_core_write_regs(1u << n, regs);
+}
+
+int swdp_core_read(u32 n, u32 *v) {
+	u32 regs[32];
+	n &= 0x1F;
+	if (swdp_core_read_regs(1u << n, regs)) {
+		return -1;
+	}
+	*v = regs[n];
 	return 0;
 }
 
+int swdp_core_read_all(u32 *v) {
+	return swdp_core_read_regs(0x7FFFF, v);
+}
+
 int swdp_step_no_ints = 0;
 
 int swdp_core_halt(void) {
@@ -80,6 +219,7 @@ int swdp_core_halt(void) {
 
 int swdp_core_step(void) {
 	u32 x;
+	regcache_valid = 0;
 	if (mem_rd_32(CDBG_CSR, &x)) return -1;
 	x &= (CDBG_C_HALT | CDBG_C_DEBUGEN | CDBG_C_MASKINTS);
 	x |= CDBG_CSR_KEY;
@@ -109,6 +249,7 @@ int swdp_core_step(void) {
 
 int swdp_core_resume(void) {
 	u32 x;
+	regcache_valid = 0;
 	if (mem_rd_32(CDBG_CSR, &x)) return -1;
 	x &= (CDBG_C_HALT | CDBG_C_DEBUGEN | CDBG_C_MASKINTS);
 	x |= CDBG_CSR_KEY | CDBG_C_DEBUGEN;
@@ -156,19 +297,20 @@ int swdp_ahb_wait_for_change(u32 addr, u32 oldval) {
 }
 
 int swdp_watchpoint(unsigned n, u32 addr, u32 func) {
-	int r;
+	debug_batch b;
 	if (n > 3)
 		return -1;
 
+	debug_batch_init(&b);
 	/* enable DWT, enable all exception traps */
-	r = mem_wr_32(DEMCR, DEMCR_TRCENA | DEMCR_VC_CORERESET);
-	r |= mem_wr_32(DWT_FUNC(n), DWT_FN_DISABLED);
+	debug_batch_wr_32(&b, DEMCR, DEMCR_TRCENA | DEMCR_VC_CORERESET);
+	debug_batch_wr_32(&b, DWT_FUNC(n), DWT_FN_DISABLED);
 	if (func != DWT_FN_DISABLED) {
-		r |= mem_wr_32(DWT_COMP(n), addr);
-		r |= mem_wr_32(DWT_MASK(n), 0);
-		r |= mem_wr_32(DWT_FUNC(n), func);
+		debug_batch_wr_32(&b, DWT_COMP(n), addr);
+		debug_batch_wr_32(&b, DWT_MASK(n), 0);
+		debug_batch_wr_32(&b, DWT_FUNC(n), func);
 	}
-	return r;
+	return debug_batch_commit(&b);
 }
 
 int swdp_watchpoint_pc(unsigned n, u32 addr) {
@@ -38,6 +38,14 @@
 #define DEMCR_VC_MMERR		(1 << 4)  // Vector Catch: MemManage Exception
 #define DEMCR_VC_CORERESET	(1 << 0)  // Vector Catch: Core Reset
 
+// ---- system control -------------------
+#define AIRCR			0xE000ED0C // App Interrupt & Reset Ctrl
+
+#define AIRCR_VECTKEY		0x05FA0000
+#define AIRCR_SYSRESETREQ	(1 << 2)  // Request System Reset
+#define AIRCR_VECTCLRACTIVE	(1 << 1)  // Clear Active Exception State
+#define AIRCR_VECTRESET		(1 << 0)  // Reset Core (v7m only)
+
 // ---- fault status registers -----------
 #define CFSR			0xE000ED28 // Configurable Fault Status Register
 #define HFSR			0xE000ED2C // Hard Fault Status Register
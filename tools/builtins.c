@@ -8,66 +8,127 @@ static struct {
 	size_t size;
 	void *data;
 } files[] = {
-	{ "agent-lpclink2.bin", 576,
-	"\x66\x61\x77\x42\x00\x00\x01\x00\x00\x00\x00\x00\x00\x04\x08\x10"
+	{ "agent-lpclink2.bin", 964,
+	"\x66\x61\x77\x42\x00\x00\x01\x00\x06\x00\x00\x00\x00\x04\x08\x10"
 	"\x00\x08\x08\x10\x00\x80\x00\x00\x00\x00\x00\x00\x00\x00\x10\x00"
+	"\x9C\x07\x08\x10\x00\x10\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+	"\x41\x04\x08\x10\x79\x04\x08\x10\x19\x05\x08\x10\x97\x07\x08\x10"
+	"\x46\xF2\x8C\x10\x43\xF2\x00\x01\xC4\xF2\x08\x00\x13\x22\x53\x23"
+	"\xC4\xF2\x00\x01\x02\x60\x43\x60\x83\x60\xC3\x60\x03\x61\x42\x61"
+	"\x10\x20\xC8\x61\xC8\x69\xC0\x06\xFC\xD4\x4F\xF6\xFF\x72\xC0\xF2"
+	"\x0F\x02\x00\x20\x0A\x60\x70\x47\x2D\xE9\xF0\x41\x02\x05\x1C\xBF"
+	"\x6F\xF0\x02\x00\xBD\xE8\xF0\x81\x00\x29\x3D\xD0\x43\xF2\x04\x02"
+	"\x44\xF2\x00\x08\x41\xF2\x00\x04\x4F\xF6\x00\x45\xC4\xF2\x00\x02"
+	"\x4F\xF0\xC4\x6C\x4F\xF0\x02\x5E\xC0\xF2\x20\x58\xC0\xF2\x80\x34"
+	"\xCF\xF6\xFF\x75\xC2\xF8\x00\xC0\x96\x69\xB6\x07\xFC\xD4\x50\x60"
+	"\xC2\xF8\x00\xE0\x96\x69\xB6\x07\xFC\xD4\xC2\xF8\x00\x80\x00\xBF"
+	"\x96\x69\xB6\x07\xFC\xD4\x16\x7C\x00\x26\x2F\x46\x50\x60\x14\x60"
+	"\x13\x69\x01\x33\x18\xBF\x4F\xF0\xFF\x36\x01\x37\xF8\xD3\x00\xBF"
+	"\x93\x69\x9B\x07\xFC\xD4\x56\xB9\xB1\xF5\x80\x5F\x04\xD3\xB1\xF5"
+	"\x80\x51\x00\xF5\x80\x50\xD5\xD1\x00\x20\xBD\xE8\xF0\x81\x4F\xF0"
+	"\xFF\x30\xBD\xE8\xF0\x81\xD4\xD4\x2D\xE9\xF0\x4F\x03\x05\x1C\xBF"
+	"\x6F\xF0\x02\x00\xBD\xE8\xF0\x8F\x43\xF2\x04\x03\x00\x2A\xC4\xF2"
+	"\x00\x03\x53\xD0\x48\xF2\x00\x19\x44\xF2\x00\x0A\x40\xF2\x00\x1B"
+	"\x01\xEB\x02\x0C\x4F\xF0\x00\x0E\xC0\xF2\x80\x29\xC0\xF2\x20\x5A"
+	"\xC0\xF2\x80\x3B\xFF\x2A\x08\xD8\x00\x24\x00\xBF\x0C\xF8\x04\xE0"
+	"\x01\x34\x15\x19\x01\x3D\xFF\x2D\xF8\xDB\x4F\xF0\xC4\x64\x1C\x60"
+	"\x9C\x69\xA4\x07\xFC\xD4\x00\x24\x58\x60\xC3\xF8\x00\x90\x00\xBF"
+	"\x51\xF8\x24\x50\x01\x34\x40\x2C\x1D\x61\xF9\xD1\x9C\x69\xA4\x07"
+	"\xFC\xD4\xC3\xF8\x00\xA0\x00\xBF\x9C\x69\xA4\x07\xFC\xD4\x1C\x7C"
+	"\x00\x24\x41\x25\x0E\x46\x58\x60\xC3\xF8\x00\xB0\x1F\x69\x56\xF8"
+	"\x04\x8B\x01\x3D\x47\x45\x18\xBF\x4F\xF0\xFF\x34\x01\x2D\xF5\xD8"
+	"\x9D\x69\xAD\x07\xFC\xD4\x7C\xB9\xB2\xF5\x80\x7F\x06\xD3\xB2\xF5"
+	"\x80\x72\x00\xF5\x80\x70\x01\xF5\x80\x71\xBB\xD1\x4F\xF0\x60\x70"
+	"\x58\x61\x00\x20\xBD\xE8\xF0\x8F\x4F\xF0\xFF\x30\xBD\xE8\xF0\x8F"
+	"\x2D\xE9\xF0\x4F\x91\xB0\x01\x38\x03\x28\x29\xD8\x88\x46\x91\x46"
+	"\xDF\xE8\x00\xF0\x02\x29\x4F\xAB\x40\xF2\x9C\x74\xC1\xF2\x08\x04"
+	"\xD4\xF8\x00\xA0\x1E\x46\x00\x2B\x00\xF0\x9D\x80\x00\x25\x00\xBF"
+	"\x60\x68\xA8\x42\xFC\xD0\x05\xF0\x01\x00\x37\x46\x00\xFB\x0A\x81"
+	"\x56\x45\x88\xBF\x57\x46\x48\x46\x3A\x46\xFF\xF7\x6D\xFF\x00\x28"
+	"\x40\xF0\xA0\x80\x01\x35\xF6\x1B\xB9\x44\xA5\x60\xE8\xD1\x82\xE0"
+	"\x6F\xF0\x01\x00\x9C\xE0\x40\xF2\x9C\x74\xC1\xF2\x08\x04\x00\x25"
+	"\x20\x6A\x00\x28\xFC\xD0\x01\x38\x03\x28\x08\xD8\xDF\xE8\x00\xF0"
+	"\x02\x0A\x10\x86\x20\x69\x61\x69\xFF\xF7\xFE\xFE\x0E\xE0\x6F\xF0"
+	"\x01\x00\x0B\xE0\x20\x69\x61\x69\xA2\x69\xFF\xF7\x45\xFF\x05\xE0"
+	"\x20\x69\x61\x69\xA2\x69\xE3\x69\xFF\xF7\xAA\xFF\x60\x62\x25\x62"
+	"\xDE\xE7\xB9\xF1\x00\x0F\x56\xD0\x43\xF2\x04\x00\x48\xF2\x20\x33"
+	"\xC4\xF2\x00\x00\x4F\xF0\x60\x7C\x01\xAA\xCE\xF6\xB8\x53\x00\xBF"
+	"\xD8\xE9\x00\xEA\x4E\xEA\x0A\x01\x89\x07\x5F\xD1\x4F\xF0\xFF\x34"
+	"\xBA\xF1\x00\x0F\x37\xD0\x00\xBF\xD3\x46\xBA\xF1\x40\x0F\x28\xBF"
+	"\x4F\xF0\x40\x0B\x0B\xF0\x7C\x01\x01\xF1\x60\x71\x5F\xEA\x9B\x06"
+	"\xC0\xF8\x04\xE0\x01\x60\x07\xD0\x11\x46\x00\xBF\x07\x69\x01\x3E"
+	"\x41\xF8\x04\x7B\xFA\xD1\x00\xBF\x81\x69\x89\x07\xFC\xD4\x5E\x46"
+	"\x00\x27\xC0\xF8\x14\xC0\xBB\xF1\x01\x0F\x98\xBF\x01\x26\x00\xBF"
+	"\xD1\x5D\x4C\x40\x08\x21\x00\xBF\x04\xF0\x01\x05\x6D\x42\x1D\x40"
+	"\x01\x39\x85\xEA\x54\x04\xF7\xD1\x01\x37\xB7\x42\xF0\xD1\xBA\xEB"
+	"\x0B\x0A\xDE\x44\xC8\xD1\xE1\x43\xB9\xF1\x01\x09\xC8\xF8\x08\x10"
+	"\x08\xF1\x0C\x08\xB4\xD1\x00\x20\x1A\xE0\x4F\xF4\x80\x51\x01\x22"
+	"\x00\x20\xC8\xE9\x00\x12\xB9\xF1\x00\x0F\xC8\xF8\x08\x00\x1E\xBF"
+	"\x4F\xF4\x80\x72\x08\xF1\x0C\x03\x07\xC3\x09\xE0\x00\x20\x60\x62"
+	"\x20\x62\x05\xE0\x4F\xF0\xFF\x31\xA1\x60\x01\xE0\x6F\xF0\x02\x00"
+	"\x11\xB0\xBD\xE8\xF0\x8F\xFF\xF7\x2B\xBF\xD4\xD4\x00\x00\x00\x00"
 	"\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"
-	"\x71\x04\x08\x10\x9D\x05\x08\x10\xC1\x04\x08\x10\xB9\x04\x08\x10"
-	"\x07\x49\x0B\x68\x06\x4A\x13\xF0\x02\x0F\xFA\xD1\x05\x49\x06\x4B"
-	"\x19\x60\x13\x68\x9B\x07\xFC\xD4\x04\x4B\x1B\x78\x70\x47\x00\xBF"
-	"\x1C\x30\x00\x40\x00\x40\x20\x05\x04\x30\x00\x40\x14\x30\x00\x40"
-	"\x0C\x4B\x0D\x49\x13\x22\x1A\x60\x53\x23\x0B\x60\x4B\x60\x8B\x60"
-	"\xCB\x60\x0A\x4B\x1A\x60\xA3\xF5\x03\x23\xA3\xF5\xC2\x73\x10\x22"
-	"\x1A\x60\x18\x68\x10\xF0\x10\x00\xFB\xD1\x05\x4A\x05\x4B\x1A\x60"
-	"\x70\x47\x00\xBF\x8C\x61\x08\x40\x90\x61\x08\x40\xA0\x61\x08\x40"
-	"\xFF\xFF\x0F\x00\x00\x30\x00\x40\x6F\xF0\x01\x00\x70\x47\x00\x00"
-	"\xC0\xF3\x0B\x03\x2D\xE9\xF0\x47\x15\x46\x00\x2B\x4F\xD1\xDF\xF8"
-	"\xC4\x80\x01\xF5\x80\x74\xC2\x46\xA4\xF5\x80\x76\x00\x2D\x3A\xD0"
-	"\xFF\x2D\x04\xD9\x26\x4F\x4F\xF0\xC4\x63\x3B\x60\x06\xE0\x73\x19"
-	"\x00\x22\x03\xF8\x01\x2B\xA3\x42\xFB\xD1\xF3\xE7\xD8\xF8\x00\x30"
-	"\x99\x07\xFB\xD4\x1F\x4B\xDF\xF8\x90\x90\x1F\x4A\xC9\xF8\x00\x00"
-	"\x3B\x60\x33\x46\x9C\x42\x03\xD0\x53\xF8\x04\x1B\x11\x60\xF9\xE7"
-	"\xFF\xF7\x8E\xFF\x19\x4B\x18\x4A\xC9\xF8\x00\x00\x3B\x60\x00\x23"
-	"\xA6\x42\x07\xD0\x17\x68\x56\xF8\x04\x1B\x8F\x42\x18\xBF\x4F\xF0"
-	"\xFF\x33\xF5\xE7\xDA\xF8\x00\x20\x92\x07\xFB\xD4\x9B\xB9\xFF\x2D"
-	"\x04\xF5\x80\x74\x06\xD8\x0E\x4B\x4F\xF0\x60\x72\x1A\x60\x00\x20"
-	"\xBD\xE8\xF0\x87\xA5\xF5\x80\x75\x00\xF5\x80\x70\xB4\xE7\x6F\xF0"
-	"\x02\x00\xBD\xE8\xF0\x87\x4F\xF0\xFF\x30\xBD\xE8\xF0\x87\x00\xBF"
-	"\x04\x30\x00\x40\x00\x81\x80\x02\x14\x30\x00\x40\x00\x01\x80\x03"
-	"\x18\x30\x00\x40\x1C\x30\x00\x40\x08\x30\x00\x40\x2D\xE9\xF8\x4F"
-	"\xC0\xF3\x0B\x03\x88\x46\x00\x2B\x37\xD1\xDF\xF8\x8C\x90\x0D\x46"
-	"\xCA\x46\x00\xEB\x08\x06\x76\x1B\x4D\xB3\x1C\x4F\x4F\xF0\xC4\x63"
-	"\x3B\x60\xD9\xF8\x00\x30\x13\xF0\x02\x04\xFA\xD1\xDF\xF8\x6C\xB0"
-	"\x4F\xF0\x02\x53\xCB\xF8\x00\x60\x3B\x60\xFF\xF7\x31\xFF\x14\x4B"
-	"\xCB\xF8\x00\x60\x40\xF2\x01\x42\x3B\x60\x23\x46\x11\x49\x01\x3A"
-	"\x05\xD0\x0C\x68\x01\x34\x18\xBF\x4F\xF0\xFF\x33\xF7\xE7\xDA\xF8"
-	"\x00\x20\x92\x07\xFB\xD4\x63\xB9\xB5\xF5\x80\x5F\x02\xD2\x00\x20"
-	"\xBD\xE8\xF8\x8F\xA5\xF5\x80\x55\xCB\xE7\x6F\xF0\x02\x00\xBD\xE8"
-	"\xF8\x8F\x4F\xF0\xFF\x30\xBD\xE8\xF8\x8F\x00\xBF\x04\x30\x00\x40"
-	"\x00\x10\x80\x03\x14\x30\x00\x40\x1C\x30\x00\x40\x08\x30\x00\x40"
+	"\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+	"\x00\x00\x00\x00"
 	},
-	{ "agent-stm32f4xx.bin", 328,
-	"\x66\x61\x77\x42\x00\x00\x01\x00\x00\x00\x00\x00\x00\x04\x00\x20"
+	{ "agent-stm32f4xx.bin", 900,
+	"\x66\x61\x77\x42\x00\x00\x01\x00\x06\x00\x00\x00\x00\x04\x00\x20"
 	"\x00\x08\x00\x20\x00\x80\x00\x00\x00\x00\x00\x00\x00\x00\x10\x00"
-	"\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"
-	"\x41\x04\x00\x20\x5D\x04\x00\x20\xC9\x04\x00\x20\xC1\x04\x00\x20"
-	"\x04\x4B\x05\x4A\x1A\x60\x02\xF1\x88\x32\x1A\x60\xD8\x68\xC0\x17"
-	"\x70\x47\x00\xBF\x04\x3C\x02\x40\x23\x01\x67\x45\xF0\xB5\x04\x46"
-	"\x14\x4B\x00\x22\x53\xF8\x22\x00\x12\x4E\xA0\x42\x05\xD0\x01\x32"
-	"\x0C\x2A\xF7\xD1\x6F\xF0\x02\x00\xF0\xBD\x0F\x4D\x0F\x4F\xD3\x00"
-	"\x43\xF0\x02\x00\x43\xF4\x80\x33\x43\xF0\x02\x03\x28\x60\x2B\x60"
-	"\x3B\x68\xD8\x03\xFC\xD4\x13\xF0\xF2\x00\x08\xD1\x01\x32\x0C\x2A"
-	"\x07\xD0\x56\xF8\x22\x30\x1B\x1B\x8B\x42\xE8\xD3\xF0\xBD\x4F\xF0"
-	"\xFF\x30\xF0\xBD\x14\x05\x00\x20\x10\x3C\x02\x40\x0C\x3C\x02\x40"
-	"\x6F\xF0\x01\x00\x70\x47\x00\x00\x40\xEA\x02\x03\x9B\x07\xF0\xB5"
-	"\x19\xD1\x40\xF2\x01\x24\x0D\x4B\x0D\x4E\x1C\x60\x0C\x46\x45\x1A"
-	"\x10\x1B\x08\x18\x0D\xD0\x20\x68\x60\x51\x04\x34\x30\x68\x10\xF4"
-	"\x80\x37\xFB\xD1\x10\xF0\xF2\x0F\xF2\xD0\x1F\x60\x4F\xF0\xFF\x30"
-	"\xF0\xBD\x18\x60\xF0\xBD\x6F\xF0\x02\x00\xF0\xBD\x10\x3C\x02\x40"
-	"\x0C\x3C\x02\x40\x00\x00\x00\x00\x00\x40\x00\x00\x00\x80\x00\x00"
+	"\x5C\x07\x00\x20\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+	"\x41\x04\x00\x20\x65\x04\x00\x20\x0D\x05\x00\x20\x01\x07\x00\x20"
+	"\x43\xF6\x04\x40\x40\xF2\x23\x11\xC4\xF2\x02\x00\xC4\xF2\x67\x51"
+	"\x01\x60\x48\xF6\xAB\x11\xCC\xF6\xEF\x51\x01\x60\xC0\x68\xC0\x17"
+	"\x70\x47\xD4\xD4\x70\xB5\xD8\xB9\x00\x22\xB2\xEB\x11\x5F\x17\xD0"
+	"\x43\xF6\x10\x40\xC4\xF2\x02\x00\x04\x21\x01\x60\x02\x21\xC0\xF2"
+	"\x01\x01\x02\x31\x01\x60\x00\xBF\x50\xF8\x04\x1C\xCA\x03\xFB\xD4"
+	"\x00\x22\x02\x60\x11\xF0\xF2\x00\x18\xBF\x4F\xF0\xFF\x30\x70\xBD"
+	"\x40\xF2\x04\x7C\x00\x22\xC2\xF2\x00\x0C\x00\xBF\x5C\xF8\x22\x30"
+	"\x83\x42\x05\xD0\x01\x32\x0C\x2A\xF8\xD1\x6F\xF0\x02\x00\x70\xBD"
+	"\x43\xF6\x10\x43\x40\xF2\x02\x0E\xC4\xF2\x02\x03\xC0\xF2\x01\x0E"
+	"\x78\x24\x00\xBF\x04\xEA\xC2\x05\xAE\x1C\x45\xEA\x0E\x05\x1E\x60"
+	"\x1D\x60\x00\xBF\x53\xF8\x04\x5C\xEE\x03\xFB\xD4\x15\xF0\xF2\x0F"
+	"\x09\xD1\x01\x32\x0C\x2A\x04\xD0\x5C\xF8\x22\x50\x2D\x1A\x8D\x42"
+	"\xE8\xD3\x00\x20\x70\xBD\x4F\xF0\xFF\x30\x70\xBD\x42\xEA\x00\x03"
+	"\x9B\x07\x1C\xBF\x6F\xF0\x02\x00\x70\x47\x10\xB5\x43\xF6\x0C\x4E"
+	"\xC4\xF2\x02\x0E\x40\xF2\x01\x23\x4F\xF0\x00\x0C\xCE\xF8\x04\x30"
+	"\x7A\xB1\x0B\x68\x04\x3A\x03\x60\xDE\xF8\x00\x30\xDC\x03\xFB\xD4"
+	"\x04\x31\x13\xF0\xF2\x0F\x00\xF1\x04\x00\xF1\xD0\x4F\xF0\xFF\x30"
+	"\x00\xE0\x00\x20\xCE\xF8\x04\xC0\x10\xBD\xD4\xD4\x2D\xE9\xF0\x47"
+	"\x90\xB0\x01\x38\x03\x28\x29\xD8\x88\x46\x92\x46\xDF\xE8\x00\xF0"
+	"\x02\x29\x4F\x96\x40\xF2\x5C\x74\xC2\xF2\x00\x04\xD4\xF8\x00\x90"
+	"\x1E\x46\x00\x2B\x00\xF0\xAD\x80\x00\x25\x00\xBF\x60\x68\xA8\x42"
+	"\xFC\xD0\x05\xF0\x01\x00\x37\x46\x00\xFB\x09\x81\x4E\x45\x88\xBF"
+	"\x4F\x46\x50\x46\x3A\x46\xFF\xF7\xB1\xFF\x00\x28\x40\xF0\x9F\x80"
+	"\x01\x35\xF6\x1B\xBA\x44\xA5\x60\xE8\xD1\x92\xE0\x6F\xF0\x01\x00"
+	"\x9B\xE0\x40\xF2\x5C\x74\xC2\xF2\x00\x04\x00\x25\x20\x6A\x00\x28"
+	"\xFC\xD0\x01\x38\x03\x28\x08\xD8\xDF\xE8\x00\xF0\x02\x0A\x10\x85"
+	"\x20\x69\x61\x69\xFF\xF7\x3E\xFF\x0E\xE0\x6F\xF0\x01\x00\x0B\xE0"
+	"\x20\x69\x61\x69\xA2\x69\xFF\xF7\x89\xFF\x05\xE0\x20\x69\x61\x69"
+	"\xA2\x69\xE3\x69\xFF\xF7\xAA\xFF\x60\x62\x25\x62\xDE\xE7\xBA\xF1"
+	"\x00\x0F\x66\xD0\x48\xF2\x20\x31\x68\x46\xCE\xF6\xB8\x51\x00\xBF"
+	"\xD8\xE9\x00\xCE\x4C\xEA\x0E\x02\x92\x07\x64\xD1\x4F\xF0\xFF\x37"
+	"\xBE\xF1\x00\x0F\x29\xD0\x00\xBF\xBE\xF1\x40\x0F\x76\x46\x28\xBF"
+	"\x40\x26\xB3\x08\x08\xD0\x02\x46\x64\x46\x00\xBF\x54\xF8\x04\x5B"
+	"\x01\x3B\x42\xF8\x04\x5B\xF9\xD1\x33\x46\x00\x24\x01\x2E\x98\xBF"
+	"\x01\x23\x00\xBF\x02\x5D\x57\x40\x08\x22\x00\xBF\x07\xF0\x01\x05"
+	"\x6D\x42\x0D\x40\x01\x3A\x85\xEA\x57\x07\xF7\xD1\x01\x34\x9C\x42"
+	"\xF0\xD1\xBE\xEB\x06\x0E\xB4\x44\xD6\xD1\xFA\x43\xBA\xF1\x01\x0A"
+	"\xC8\xF8\x08\x20\x08\xF1\x0C\x08\xC2\xD1\x22\xE0\x04\x20\x03\x21"
+	"\x01\x22\xBA\xF1\x00\x0F\xC8\xE9\x00\x01\xC8\xF8\x08\x20\x18\xD0"
+	"\xAA\xF1\x01\x00\x40\xF2\x38\x71\x02\x28\x28\xBF\x02\x20\xC2\xF2"
+	"\x00\x01\x01\x30\x08\x31\x08\xF1\x0C\x02\x00\xBF\x51\xE9\x02\x37"
+	"\x01\x38\xC2\xE9\x00\x37\x51\xF8\x0C\x3B\x93\x60\x02\xF1\x0C\x02"
+	"\xF4\xD1\x00\x20\x09\xE0\x00\x20\x60\x62\x20\x62\x05\xE0\x4F\xF0"
+	"\xFF\x31\xA1\x60\x01\xE0\x6F\xF0\x02\x00\x10\xB0\xBD\xE8\xF0\x87"
+	"\xFF\xF7\x2C\xBF\x00\x00\x00\x00\x00\x40\x00\x00\x00\x80\x00\x00"
 	"\x00\xC0\x00\x00\x00\x00\x01\x00\x00\x00\x02\x00\x00\x00\x04\x00"
 	"\x00\x00\x06\x00\x00\x00\x08\x00\x00\x00\x0A\x00\x00\x00\x0C\x00"
-	"\x00\x00\x0E\x00\x00\x00\x10\x00"
+	"\x00\x00\x0E\x00\x00\x00\x10\x00\x00\x00\x00\x00\x00\x40\x00\x00"
+	"\x04\x00\x00\x00\x00\x00\x01\x00\x00\x00\x01\x00\x01\x00\x00\x00"
+	"\x00\x00\x02\x00\x00\x00\x02\x00\x07\x00\x00\x00\x00\x00\x00\x00"
+	"\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+	"\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+	"\x00\x00\x00\x00"
 	},
 	{ "agent-stm32f0xx.bin", 408,
 	"\x66\x61\x77\x42\x00\x00\x01\x00\x00\x00\x00\x00\x00\x04\x00\x20"
@@ -21,6 +21,7 @@
 #include <string.h>
 #include <ctype.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <errno.h>
 
 #include <fcntl.h>
@@ -33,6 +34,7 @@
 
 #include "debugger.h"
 #include "lkdebug.h"
+#include "jtag.h"
 
 #define _AGENT_HOST_ 1
 #include <agent/flash.h>
@@ -61,11 +63,11 @@ int disassemble(u32 addr) {
 		return -1;
 
 	if (addr & 2) {
-		if (swdp_ahb_read32(addr & (~3), mem.w, 2))
+		if (memcache_read32(addr & (~3), mem.w, 2))
 			return -1;
 		r = disassemble_thumb2(addr, mem.h[1], mem.h[2], text, 128);
 	} else {
-		if (swdp_ahb_read32(addr & (~3), mem.w, 1))
+		if (memcache_read32(addr & (~3), mem.w, 1))
 			return -1;
 		r = disassemble_thumb2(addr, mem.h[0], mem.h[1], text, 128);
 	}
@@ -82,22 +84,29 @@ int do_exit(int argc, param *argv) {
 	return 0;
 }
 
+// pick the swd DP named by arg, returns -1 if arg is not one
+static int select_dp(param *arg) {
+	if (!strcmp(arg->s, "pico0")) {
+		return swdp_targetsel(0x01002927, 1);
+	} else if (!strcmp(arg->s, "pico1")) {
+		return swdp_targetsel(0x11002927, 1);
+	} else if (!strcmp(arg->s, "picor")) {
+		return swdp_targetsel(0xF1002927, 1);
+	} else if (!strcmp(arg->s, "swd")) {
+		return swdp_targetsel(0, 0);
+	} else if (!strcmp(arg->s, "swdx")) {
+		return swdp_targetsel(0xffffffff, 1);
+	} else {
+		return -1;
+	}
+}
+
+// bumped whenever the target may have been reset or replaced
+static u32 target_gen = 1;
+
 int do_attach(int argc, param *argv) {
 	if (argc > 0) {
-		if (!strcmp(argv[0].s, "pico0")) {
-			swdp_targetsel(0x01002927, 1);
-			ACTIVE_TRANSPORT = &SWDP_TRANSPORT;
-		} else if (!strcmp(argv[0].s, "pico1")) {
-			swdp_targetsel(0x11002927, 1);
-			ACTIVE_TRANSPORT = &SWDP_TRANSPORT;
-		} else if (!strcmp(argv[0].s, "picor")) {
-			swdp_targetsel(0xF1002927, 1);
-			ACTIVE_TRANSPORT = &SWDP_TRANSPORT;
-		} else if (!strcmp(argv[0].s, "swd")) {
-			swdp_targetsel(0, 0);
-			ACTIVE_TRANSPORT = &SWDP_TRANSPORT;
-		} else if (!strcmp(argv[0].s, "swdx")) {
-			swdp_targetsel(0xffffffff, 1);
+		if (!select_dp(argv)) {
 			ACTIVE_TRANSPORT = &SWDP_TRANSPORT;
 		} else if (!strcmp(argv[0].s, "jtag")) {
 			ACTIVE_TRANSPORT = &JTAG_TRANSPORT;
@@ -105,15 +114,39 @@ int do_attach(int argc, param *argv) {
 			xprintf(XCORE, "unknown transport '%s'\n", argv[0].s);
 		}
 	}
+	swdp_core_cache_invalidate();
+	memcache_flush();
+	target_gen++;
 	return swdp_reset();
 }
 
+// switch between DPs on a multi-drop bus, attaching only the first time
+int do_dp(int argc, param *argv) {
+	if (argc == 0) {
+		swdp_dp_list();
+		return 0;
+	}
+	if (select_dp(argv) && swdp_targetsel(argv[0].n, 1)) {
+		return -1;
+	}
+	ACTIVE_TRANSPORT = &SWDP_TRANSPORT;
+	swdp_core_cache_invalidate();
+	if (!swdp_dp_attached()) {
+		memcache_flush();
+		target_gen++;
+		return swdp_reset();
+	}
+	return 0;
+}
+
 int debug_target(const char* name) {
 	if (!strcmp(name,"pico")) {
 		xprintf(XDATA, "target: RPxxxx MCUs\n");
 		xprintf(XDATA, "target: use 'attach pico0', 'attach pico1' to change cores\n");
 		xprintf(XDATA, "target: use 'attach picor' to enter rescue (reset-stop-in-rom)\n");
 		swdp_targetsel(0x01002927, 1);
+		// rp2040 only auto-increments TAR within 1K
+		swdp_set_wrapsize(0x400);
 		return 0;
 	} else {
 		xprintf(XDATA, "target: unknown target '%s'\n", name);
@@ -243,6 +276,8 @@ int do_wr(int argc, param *argv) {
 			return 0;
 		}
 	}
+	swdp_core_cache_check_write(argv[0].n, 4, argv[1].n);
+	memcache_invalidate(argv[0].n, 4);
 	swdp_ahb_write(argv[0].n, argv[1].n);
 	xprintf(XDATA, "%08x<<%08x\n", argv[0].n, argv[1].n);
 	return 0;
@@ -257,7 +292,7 @@ int do_text(int argc, param *argv) {
 	addr = argv[0].n;
 	memset(data, 0, sizeof(data));
 
-	if (swdp_ahb_read32(addr, (void*) data, sizeof(data)/4))
+	if (memcache_read32(addr, (void*) data, sizeof(data)/4))
 		return -1;
 
 	data[sizeof(data)-1] = 0;
@@ -296,7 +331,7 @@ int do_dw(int argc, param *argv) {
 	lastcount = count;
 
 	count /= 4;
-	if (swdp_ahb_read32(addr, data, count))
+	if (memcache_read32(addr, data, count))
 		return -1;
 
 	for (n = 0; count > 0; n += 4, addr += 16) {
@@ -326,7 +361,7 @@ int do_dw(int argc, param *argv) {
 }
 
 
-int do_db(int argc, param *argv) {
+static int dump_sized(int argc, param *argv, unsigned size) {
 	u32 addr, count;
 	u8 data[1024];
 	char line[256];
@@ -335,55 +370,69 @@ int do_db(int argc, param *argv) {
 	if (argc < 2)
 		return -1;
 
-	addr = argv[0].n;
-	count = argv[1].n;
+	addr = argv[0].n & ~(size - 1);
+	count = argv[1].n & ~(size - 1);
 
 	if (count > 1024)
 		count = 1024;
+	if (count == 0)
+		return 0;
 
 	memset(data, 0xee, 1024);
-	// todo: fix this
-	swdp_ahb_write(AHB_CSW, AHB_CSW_MDEBUG | AHB_CSW_PRIV |
-		AHB_CSW_DBG_EN | AHB_CSW_8BIT);
-	for (n = 0; n < count; n++) {
-		u32 tmp;
-		if (swdp_ahb_read(addr + n, &tmp)) {
-			swdp_reset();
-			break;
-		}
-		data[n] = tmp >> (8 * (n & 3));
+	if (mem_rd_c(addr, data, count / size, size)) {
+		swdp_reset();
+		return -1;
 	}
-	swdp_ahb_write(AHB_CSW, AHB_CSW_MDEBUG | AHB_CSW_PRIV |
-		AHB_CSW_DBG_EN | AHB_CSW_32BIT);
 
 	for (n = 0; count > 0; count -= xfer) {
 		xfer = (count > 16) ? 16 : count;
 		char *p = line + sprintf(line, "%08x:", addr + n);
-		for (m = 0; m < xfer; m++) {
-			p += sprintf(p, " %02x", data[n++]);
+		for (m = 0; m < xfer; m += size, n += size) {
+			if (size == 1) {
+				p += sprintf(p, " %02x", data[n]);
+			} else {
+				p += sprintf(p, " %04x", data[n] | (data[n + 1] << 8));
+			}
 		}
 		xprintf(XDATA, "%s\n", line);
 	}
 	return 0;
 }
 
+int do_db(int argc, param *argv) {
+	return dump_sized(argc, argv, 1);
+}
+
+int do_dh(int argc, param *argv) {
+	return dump_sized(argc, argv, 2);
+}
+
 // vector catch flags to apply
 u32 vcflags = DEMCR_VC_HARDERR | DEMCR_VC_BUSERR | DEMCR_VC_STATERR | DEMCR_VC_CHKERR;
 
 int do_reset(int argc, param *argv) {
+	swdp_core_cache_invalidate();
+	memcache_flush();
+	target_gen++;
 	swdp_core_halt();
 	swdp_ahb_write(DEMCR, DEMCR_TRCENA | vcflags);
 	/* core reset and sys reset */
 	swdp_ahb_write(0xe000ed0c, 0x05fa0005);
 	swdp_ahb_write(DEMCR, DEMCR_TRCENA | vcflags);
+	// in case anything was cached since, the reset replaced it
+	swdp_core_cache_invalidate();
 	return 0;
 }
 
 int do_reset_hw(int argc, param *argv) {
+	swdp_core_cache_invalidate();
+	memcache_flush();
+	target_gen++;
 	swdp_target_reset(1);
 	usleep(10000);
 	swdp_target_reset(0);
 	usleep(10000);
+	swdp_core_cache_invalidate();
 	return 0;
 }
 
@@ -397,9 +446,12 @@ int wait_for_stop() {
 		if (swdp_ahb_read(DHCSR, &x) == 0) {
 			if (x & DHCSR_S_HALT) {
 				xprintf(XSWD,"CPU HALTED (%u,%u)\n", n,m);
-				unsigned y = -1, z = -1;
-				swdp_ahb_read(DFSR, &y);
-				swdp_ahb_read(DEMCR, &z);
+				u32 y = -1, z = -1;
+				debug_batch b;
+				debug_batch_init(&b);
+				debug_batch_rd_32(&b, DFSR, &y);
+				debug_batch_rd_32(&b, DEMCR, &z);
+				debug_batch_commit(&b);
 				xprintf(XSWD,"DHCSR %08x (%08x)\nDFSR  %08x\nDEMCR %08x\n", x, xr, y, z);
 				return 0;
 			}
@@ -411,6 +463,7 @@ int wait_for_stop() {
 			//xprintf(XSWD,"??? %08x\n", x);
 			swdp_ahb_write(DHCSR, DHCSR_DBGKEY | DHCSR_C_HALT | DHCSR_C_DEBUGEN);
 		} else {
+			swdp_core_cache_invalidate();
 			swdp_reset();
 		}
 	}
@@ -419,6 +472,9 @@ int wait_for_stop() {
 }
 		
 int do_reset_stop(int argc, param *argv) {
+	swdp_core_cache_invalidate();
+	memcache_flush();
+	target_gen++;
 	swdp_core_halt();
 	wait_for_stop();
 
@@ -431,6 +487,7 @@ int do_reset_stop(int argc, param *argv) {
 	// sys reset
 	// TRM says requesting both at once is unpredictable...
 	swdp_ahb_write(0xe000ed0c, 0x05fa0004);
+	swdp_core_cache_invalidate();
 
 	swd_verbose = 0;
 	wait_for_stop();
@@ -488,6 +545,19 @@ int do_setclock(int argc, param *argv) {
 	return swdp_set_clock(argv[0].n);
 }
 
+int do_autoclock(int argc, param *argv) {
+	u32 scratch = 0x20000000;
+	unsigned max = 0xFFFF;
+	int r;
+	if (argc > 0)
+		scratch = argv[0].n;
+	if (argc > 1)
+		max = argv[1].n;
+	r = swdp_autoclock(scratch, max);
+	memcache_invalidate(scratch, 1024);
+	return r;
+}
+
 int do_swoclock(int argc, param *argv) {
 	if (argc < 1)
 		return -1;
@@ -599,6 +669,7 @@ int do_download(int argc, param *argv) {
 	addr = argv[1].n;
 
 	xprintf(XCORE, "sending %d bytes...\n", sz);
+	memcache_invalidate(addr, sz);
 	t0 = now();
 	if (swdp_ahb_write32(addr, (void*) data, sz / 4)) {
 		xprintf(XCORE, "error: failed to write data\n");
@@ -616,7 +687,7 @@ int do_run(int argc, param *argv) {
 	u32 addr;
 	void *data;
 	size_t sz;
-	u32 sp, pc;
+	u32 regs[19];
 	if (argc != 2) {
 		xprintf(XCORE, "error: usage: run <file> <addr>\n");
 		return -1;
@@ -628,17 +699,17 @@ int do_run(int argc, param *argv) {
 	swdp_core_halt();
 	sz = (sz + 3) & ~3;
 	addr = argv[1].n;
+	memcache_invalidate(addr, sz);
 	if (swdp_ahb_write32(addr, (void*) data, sz / 4)) {
 		xprintf(XCORE, "error: failed to write data\n");
 		free(data);
 		return -1;
 	}
-	memcpy(&sp, data, 4);
-	memcpy(&pc, ((char*) data) + 4, 4);
-	swdp_core_write(13, sp);
-	swdp_core_write(15, pc);
+	memcpy(&regs[13], data, 4);
+	memcpy(&regs[15], ((char*) data) + 4, 4);
+	regs[16] = 0x01000000;
 	swdp_ahb_write(0xe000ed0c, 0x05fa0002);
-	swdp_core_write(16, 0x01000000);
+	swdp_core_write_regs(0x1A000, regs);
 	swdp_core_resume();
 	free(data);
 	return 0;
@@ -724,14 +795,8 @@ fail:
 	return -1;
 }
 
-int invoke(u32 agent, u32 func, u32 r0, u32 r1, u32 r2, u32 r3) {
-	swdp_core_write(0, r0);
-	swdp_core_write(1, r1);
-	swdp_core_write(2, r2);
-	swdp_core_write(3, r3);
-	swdp_core_write(13, agent - 4);
-	swdp_core_write(14, agent | 1); // include T bit
-	swdp_core_write(15, func | 1); // include T bit
+static int invoke_start(u32 agent, u32 func, u32 r0, u32 r1, u32 r2, u32 r3) {
+	u32 regs[19];
 
 	// if the target has bogus data at 0, the processor may be in
 	// pending-exception state after reset-stop, so we will clear
@@ -739,18 +804,35 @@ int invoke(u32 agent, u32 func, u32 r0, u32 r1, u32 r2, u32 r3) {
 
 	// Write VECTCLRACTIVE to AIRCR
 	swdp_ahb_write(0xe000ed0c, 0x05fa0002);
-	swdp_core_write(16, 0x01000000);
+
+	regs[0] = r0;
+	regs[1] = r1;
+	regs[2] = r2;
+	regs[3] = r3;
+	regs[13] = agent - 4;
+	regs[14] = agent | 1; // include T bit
+	regs[15] = func | 1; // include T bit
+	regs[16] = 0x01000000;
+	swdp_core_write_regs(0x1E00F, regs);
 
 	// todo: readback and verify?
 
 	xprintf(XCORE, "invoke <func@%08x>(0x%x,0x%x,0x%x,0x%x)\n", func, r0, r1, r2, r3);
 
-	swdp_core_resume();
+	return swdp_core_resume();
+}
+
+static int invoke_finish(u32 agent) {
+	u32 regs[19];
+
 	if (swdp_core_wait_for_halt() == 0) {
 		// todo: timeout after a few seconds?
-		u32 pc = 0xffffffff, res = 0xffffffff;
-		swdp_core_read(0, &res);
-		swdp_core_read(15, &pc);
+		u32 pc, res;
+		regs[0] = 0xffffffff;
+		regs[15] = 0xffffffff;
+		swdp_core_read_regs(0x08001, regs);
+		res = regs[0];
+		pc = regs[15];
 		if (pc != agent) {
 			xprintf(XCORE, "error: pc (%08x) is not at %08x\n", pc, agent);
 			return -1;
@@ -762,9 +844,475 @@ int invoke(u32 agent, u32 func, u32 r0, u32 r1, u32 r2, u32 r3) {
 	return -1;
 }
 
+int invoke(u32 agent, u32 func, u32 r0, u32 r1, u32 r2, u32 r3) {
+	if (invoke_start(agent, func, r0, r1, r2, r3)) {
+		return -1;
+	}
+	return invoke_finish(agent);
+}
+
+#define MB_CMD(a)	((a)->mailbox + offsetof(flash_mailbox, cmd))
+#define MB_ARG(a)	((a)->mailbox + offsetof(flash_mailbox, arg))
+#define MB_DONE(a)	((a)->mailbox + offsetof(flash_mailbox, done))
+#define MB_POSTED(a)	((a)->mailbox + offsetof(flash_mailbox, posted))
+
+// set while a FLAG_SERVICE agent is running its service loop
+static int agent_service = 0;
+
+// Start agent method cmd (SVC_*), through the mailbox if the
+// agent's service loop is running, or by invoking it if not.
+static int agent_start(flash_agent *agent, u32 cmd, u32 r0, u32 r1, u32 r2, u32 r3) {
+	u32 msg[5] = { r0, r1, r2, r3, cmd };
+
+	if (agent_service) {
+		xprintf(XCORE, "post <cmd %d>(0x%x,0x%x,0x%x,0x%x)\n", cmd, r0, r1, r2, r3);
+		return swdp_ahb_write32(MB_ARG(agent), msg, 5);
+	}
+	switch (cmd) {
+	case SVC_ERASE:
+		return invoke_start(agent->load_addr, agent->erase, r0, r1, r2, r3);
+	case SVC_WRITE:
+		return invoke_start(agent->load_addr, agent->write, r0, r1, r2, r3);
+	case SVC_IOCTL:
+		return invoke_start(agent->load_addr, agent->ioctl, r0, r1, r2, r3);
+	default:
+		return -1;
+	}
+}
+
+static int agent_finish(flash_agent *agent, u32 cmd) {
+	u32 msg[2];
+	int r;
+
+	if (!agent_service) {
+		return invoke_finish(agent->load_addr);
+	}
+	// the agent clears cmd after storing status
+	if ((r = swdp_ahb_wait_for_change(MB_CMD(agent), cmd)) ||
+		swdp_ahb_read32(MB_CMD(agent), msg, 2) || (msg[0] != 0)) {
+		swdp_core_halt();
+		agent_service = 0;
+		xprintf(XCORE, (r == -2) ? "interrupted\n" : "error: lost agent\n");
+		return -1;
+	}
+	if (msg[1]) xprintf(XCORE, "failure code %08x\n", msg[1]);
+	return msg[1];
+}
+
+static int agent_call(flash_agent *agent, u32 cmd, u32 r0, u32 r1, u32 r2, u32 r3) {
+	if (agent_start(agent, cmd, r0, r1, r2, r3)) {
+		return -1;
+	}
+	return agent_finish(agent, cmd);
+}
+
+static void agent_service_start(flash_agent *agent) {
+	u32 mb[sizeof(flash_mailbox) / 4];
+
+	memset(mb, 0, sizeof(mb));
+	if (swdp_ahb_write32(agent->mailbox, mb, sizeof(mb) / 4) ||
+		invoke_start(agent->load_addr, agent->ioctl, IOCTL_SERVICE, 0, 0, 0)) {
+		return;
+	}
+	agent_service = 1;
+}
+
+// leave the agent halted, as it would be without the service loop
+static void agent_service_stop(flash_agent *agent) {
+	if (!agent_service) {
+		return;
+	}
+	if (agent_start(agent, SVC_EXIT, 0, 0, 0, 0) == 0) {
+		agent_service = 0;
+		if (invoke_finish(agent->load_addr) == 0) {
+			return;
+		}
+	}
+	swdp_core_halt();
+	agent_service = 0;
+}
+
+#define GEOM_MAX	16
+
+// flash layout of the current agent, count is 0 if unknown
+static struct {
+	u32 write_size;
+	u32 count;
+	u32 flags;
+	flash_region region[GEOM_MAX];
+} geom;
+
+// Ask the agent for its flash layout, falling back to the static
+// hints in the agent header if it can't say.
+static void flash_query_geometry(flash_agent *agent) {
+	u32 buf[3 + GEOM_MAX * 3];
+	u32 max = 0;
+	u32 wsz = agent->flags & FLAG_WSZ_MASK;
+
+	geom.count = 0;
+	geom.flags = 0;
+	geom.write_size = wsz ? (wsz & -wsz) : 4;
+	// only agents built with flash-mailbox.c answer IOCTL_GEOMETRY
+	if (agent->mailbox && (agent->data_size >= sizeof(buf))) {
+		max = GEOM_MAX;
+	}
+	if (max && (agent_call(agent, SVC_IOCTL, IOCTL_GEOMETRY, agent->data_addr, max, 0) == 0) &&
+		(swdp_ahb_read32(agent->data_addr, buf, 3 + max * 3) == 0) &&
+		(buf[0] != 0) && (buf[1] != 0) && (buf[1] <= max)) {
+		geom.write_size = buf[0];
+		geom.count = buf[1];
+		geom.flags = buf[2];
+		memcpy(geom.region, buf + 3, geom.count * sizeof(flash_region));
+		for (max = 0; max < geom.count; max++) {
+			if (geom.region[max].sector_size == 0) {
+				geom.count = 0;
+				return;
+			}
+		}
+		xprintf(XCORE, "flash: %d regions, %d byte write blocks\n",
+			geom.count, geom.write_size);
+		return;
+	}
+	if (agent->sector_size) {
+		geom.count = 1;
+		geom.region[0].base = agent->flash_addr;
+		geom.region[0].sector_size = agent->sector_size;
+		geom.region[0].count = agent->flash_size / agent->sector_size;
+	}
+}
+
+// find the erase sector holding addr
+static int flash_sector(u32 addr, u32 *start, u32 *size) {
+	flash_region *r;
+	unsigned n;
+	for (n = 0; n < geom.count; n++) {
+		r = geom.region + n;
+		if ((addr >= r->base) && ((addr - r->base) / r->sector_size < r->count)) {
+			*size = r->sector_size;
+			*start = addr - ((addr - r->base) % r->sector_size);
+			return 0;
+		}
+	}
+	return -1;
+}
+
+// the largest download of whole write blocks that fits in len
+static u32 flash_blocks(u32 len) {
+	u32 wsz = geom.write_size;
+	if ((wsz >= 4) && (wsz <= len)) {
+		len -= len % wsz;
+	}
+	return len & ~3;
+}
+
+// Erase the sectors that hold a range, which must start on a sector
+// boundary, as the agents always required.  Only the end is rounded
+// up.  If that is every sector, erase the whole part, which the agent
+// may do with a mass erase.
+static int flash_erase(flash_agent *agent, u32 addr, u32 len) {
+	u32 start, size;
+	u32 end = addr + len;
+
+	if (geom.count && len) {
+		if ((flash_sector(addr, &start, &size) == 0) && (start != addr)) {
+			xprintf(XCORE, "cannot erase from %08x, sector starts at %08x\n",
+				addr, start);
+			return -1;
+		}
+		if (flash_sector(end - 1, &start, &size) == 0) {
+			end = start + size;
+		}
+		if ((addr <= agent->flash_addr) &&
+			(end >= (agent->flash_addr + agent->flash_size))) {
+			addr = agent->flash_addr;
+			end = addr + agent->flash_size;
+			xprintf(XCORE, "%s all of flash\n",
+				(geom.flags & GEOM_MASS_ERASE) ? "mass erasing" : "erasing");
+		} else if ((addr + len) != end) {
+			xprintf(XCORE, "erasing sectors %08x..%08x\n", addr, end);
+		}
+	}
+	if (agent_call(agent, SVC_ERASE, addr, end - addr, 0, 0)) {
+		xprintf(XCORE, "failed to erase %d bytes at %08x\n", end - addr, addr);
+		return -1;
+	}
+	return 0;
+}
+
+// Write through a FLAG_STREAM agent, downloading each chunk into one
+// half of its buffer while it programs the chunk in the other half.
+static int flash_stream(flash_agent *agent, u32 flashaddr, u8 *ptr, u32 data_sz) {
+	u32 chunk = flash_blocks(agent->data_size / 2);
+	u32 init[3] = { chunk, 0, 0 };
+	u32 n, xfer, done = 0;
+	int r;
+
+	if (swdp_ahb_write32(agent->mailbox, init, 3)) {
+		return -1;
+	}
+	if (agent_start(agent, SVC_IOCTL, IOCTL_STREAM_WRITE,
+		agent->data_addr, flashaddr, data_sz)) {
+		return -1;
+	}
+	for (n = 0; data_sz > 0; n++) {
+		// wait for the agent to be done with this half
+		while ((n - done) > 1) {
+			r = swdp_ahb_wait_for_change(MB_DONE(agent), done);
+			if ((r == 0) && (swdp_ahb_read(MB_DONE(agent), &done) == 0)) {
+				if (done == STREAM_FAILED) {
+					goto finish;
+				}
+				continue;
+			}
+			swdp_core_halt();
+			agent_service = 0;
+			xprintf(XCORE, (r == -2) ? "interrupted\n" : "error: lost agent\n");
+			return -1;
+		}
+		xfer = (data_sz > chunk) ? chunk : data_sz;
+		if (swdp_ahb_write32(agent->data_addr + (n & 1) * chunk, (void*) ptr, xfer / 4) ||
+			swdp_ahb_write(MB_POSTED(agent), n + 1)) {
+			swdp_core_halt();
+			agent_service = 0;
+			xprintf(XCORE, "download to %08x failed\n", agent->data_addr);
+			return -1;
+		}
+		ptr += xfer;
+		data_sz -= xfer;
+	}
+finish:
+	return agent_finish(agent, SVC_IOCTL);
+}
+
+static u32 crc32(u32 crc, const void *data, size_t len) {
+	const u8 *p = data;
+	unsigned n;
+	crc = ~crc;
+	while (len-- > 0) {
+		crc ^= *p++;
+		for (n = 0; n < 8; n++) {
+			crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+		}
+	}
+	return ~crc;
+}
+
+// The agent left in target RAM by the last flash operation, which
+// may be reused as long as the target has not been reset since.
+static struct {
+	u32 gen;	// target_gen when it was set up, 0 if none
+	u32 crc;	// of the image as downloaded
+	u32 info[4];	// data_addr, data_size, flash_addr, flash_size
+} resident;
+
+static int agent_is_resident(flash_agent *agent, size_t agent_sz) {
+	u32 csr, pc, mb;
+	u8 *image;
+	int r = 0;
+
+	if ((resident.gen != target_gen) ||
+		(resident.crc != crc32(0, agent, agent_sz))) {
+		return 0;
+	}
+	// still halted on the agent's breakpoint, not running the app,
+	// and not reset behind our back (S_RESET_ST is sticky until read)
+	if (swdp_ahb_read(DHCSR, &csr) || !(csr & DHCSR_S_HALT) ||
+		(csr & DHCSR_S_RESET_ST) ||
+		swdp_core_read(15, &pc) || (pc != agent->load_addr)) {
+		return 0;
+	}
+	if ((image = malloc(agent_sz)) == NULL) {
+		return 0;
+	}
+	if (swdp_ahb_read32(agent->load_addr, (void*) image, agent_sz / 4) == 0) {
+		// setup() may rewrite the sizes and the mailbox changes
+		// as the agent runs, so only the rest must match
+		memcpy(image + 16, ((u8*) agent) + 16, 16);
+		mb = agent->mailbox - agent->load_addr;
+		if ((agent->flags & (FLAG_STREAM | FLAG_SERVICE)) &&
+			(mb <= (agent_sz - sizeof(flash_mailbox)))) {
+			memcpy(image + mb, ((u8*) agent) + mb, sizeof(flash_mailbox));
+		}
+		r = !memcmp(image, agent, agent_sz);
+	}
+	free(image);
+	return r;
+}
+
+// write one range, erasing it first unless it already is
+static int flash_program(flash_agent *agent, u32 flashaddr, u8 *ptr, u32 data_sz, int erase) {
+	u32 max = flash_blocks(agent->data_size);
+	u32 xfer;
+
+	if (erase && flash_erase(agent, flashaddr, data_sz)) {
+		return -1;
+	}
+	if ((agent->flags & FLAG_STREAM) && (agent->data_size >= 8)) {
+		if (flash_stream(agent, flashaddr, ptr, data_sz)) {
+			xprintf(XCORE, "failed to flash %d bytes to %08x\n", data_sz, flashaddr);
+			return -1;
+		}
+		return 0;
+	}
+	while (data_sz > 0) {
+		if (data_sz > max) {
+			xfer = max;
+		} else {
+			xfer = data_sz;
+		}
+		if (swdp_ahb_write32(agent->data_addr, (void*) ptr, xfer / 4)) {
+			xprintf(XCORE, "download to %08x failed\n", agent->data_addr);
+			return -1;
+		}
+		if (agent_call(agent, SVC_WRITE,
+			flashaddr, agent->data_addr, xfer, 0)) {
+			xprintf(XCORE, "failed to flash %d bytes to %08x\n", xfer, flashaddr);
+			return -1;
+		}
+		ptr += xfer;
+		data_sz -= xfer;
+		flashaddr += xfer;
+	}
+	return 0;
+}
+
+// part of the image that can be erased without touching the rest
+struct flash_unit {
+	u32 addr;
+	u32 size;
+	int same;	// flash already holds this part of the image
+};
+
+// Split a range at erase sector boundaries.  Without a known
+// geometry the whole range is one unit.
+static struct flash_unit *flash_units(flash_agent *agent, u32 addr, u32 len, unsigned *_count) {
+	struct flash_unit *u;
+	u32 end = addr + len;
+	u32 next, start, size;
+	unsigned n = 0, max = 1;
+
+	for (n = 0; n < geom.count; n++) {
+		max += geom.region[n].count;
+	}
+	if ((u = calloc(max, sizeof(*u))) == NULL) {
+		return NULL;
+	}
+	n = 0;
+	while ((addr < end) && (n < max)) {
+		next = end;
+		if ((n < (max - 1)) && (flash_sector(addr, &start, &size) == 0)) {
+			next = start + size;
+			if (next > end) {
+				next = end;
+			}
+		}
+		u[n].addr = addr;
+		u[n].size = next - addr;
+		n++;
+		addr = next;
+	}
+	*_count = n;
+	return u;
+}
+
+// Have the agent CRC each unit of flash and mark the ones that
+// already match the image.  Fails if the agent has no IOCTL_CRC32,
+// which only agents built with flash-mailbox.c (and a mailbox) have.
+static int flash_compare(flash_agent *agent, struct flash_unit *u, unsigned count,
+	u8 *image, u32 base) {
+	unsigned max = agent->data_size / 12;
+	unsigned n, k;
+	u32 *table;
+
+	if ((agent->mailbox == 0) || (max == 0) || ((table = malloc(max * 12)) == NULL)) {
+		return -1;
+	}
+	while (count > 0) {
+		k = (count > max) ? max : count;
+		for (n = 0; n < k; n++) {
+			table[n * 3 + 0] = u[n].addr;
+			table[n * 3 + 1] = u[n].size;
+			table[n * 3 + 2] = 0;
+		}
+		if (swdp_ahb_write32(agent->data_addr, table, k * 3) ||
+			agent_call(agent, SVC_IOCTL, IOCTL_CRC32, agent->data_addr, k, 0) ||
+			swdp_ahb_read32(agent->data_addr, table, k * 3)) {
+			free(table);
+			return -1;
+		}
+		for (n = 0; n < k; n++) {
+			u[n].same = (table[n * 3 + 2] ==
+				crc32(0, image + (u[n].addr - base), u[n].size));
+		}
+		u += k;
+		count -= k;
+	}
+	free(table);
+	return 0;
+}
+
+// write an image, skipping the sectors that already hold it
+static int flash_image(flash_agent *agent, u32 flashaddr, u8 *image, u32 data_sz) {
+	struct flash_unit *u;
+	unsigned count, n, m, skipped = 0;
+	u32 len;
+	u32 start, size;
+	int r = 0, erase = 1;
+
+	// erasing the first sector would lose whatever precedes the image
+	if ((flash_sector(flashaddr, &start, &size) == 0) && (start != flashaddr)) {
+		xprintf(XCORE, "cannot flash at %08x, sector starts at %08x\n",
+			flashaddr, start);
+		return -1;
+	}
+	if ((u = flash_units(agent, flashaddr, data_sz, &count)) == NULL) {
+		return flash_program(agent, flashaddr, image, data_sz, 1);
+	}
+	if (flash_compare(agent, u, count, image, flashaddr)) {
+		// older agents can't, no need to say so every time
+		if (agent->mailbox) {
+			xprintf(XCORE, "agent cannot check flash, writing all of it\n");
+		}
+		for (n = 0; n < count; n++) {
+			u[n].same = 0;
+		}
+	}
+	// if the image changes every sector of the part, erase it all
+	// at once rather than run by run
+	for (n = 0; (n < count) && !u[n].same; n++) ;
+	if (geom.count && (n == count) && (flashaddr <= agent->flash_addr) &&
+		((flashaddr + data_sz) >= (agent->flash_addr + agent->flash_size))) {
+		if ((r = flash_erase(agent, flashaddr, data_sz))) {
+			goto done;
+		}
+		erase = 0;
+	}
+	for (n = 0; n < count; n = m) {
+		if (u[n].same) {
+			skipped++;
+			m = n + 1;
+			continue;
+		}
+		// program runs of changed units together
+		len = 0;
+		for (m = n; (m < count) && !u[m].same; m++) {
+			len += u[m].size;
+		}
+		if ((r = flash_program(agent, u[n].addr, image + (u[n].addr - flashaddr), len, erase))) {
+			break;
+		}
+	}
+	if (skipped) {
+		xprintf(XCORE, "%u of %u sectors unchanged\n", skipped, count);
+	}
+done:
+	free(u);
+	return r;
+}
+
 int run_flash_agent(u32 flashaddr, void *data, size_t data_sz) {
 	u8 buffer[4096];
-	flash_agent *agent;
+	flash_agent *agent = NULL;
 	size_t agent_sz;
 	int r;
 
@@ -785,6 +1333,14 @@ int run_flash_agent(u32 flashaddr, void *data, size_t data_sz) {
 	// replace magic with bkpt instructions
 	agent->magic = 0xbe00be00;
 
+	if (agent_is_resident(agent, agent_sz)) {
+		memcpy(&agent->data_addr, resident.info, sizeof(resident.info));
+		xprintf(XCORE, "agent already resident\n");
+		goto ready;
+	}
+	resident.gen = 0;
+	resident.crc = crc32(0, agent, agent_sz);
+
 	if (do_attach(0,0)) {
 		xprintf(XCORE, "error: failed to attach\n");
 		goto fail;
@@ -817,11 +1373,20 @@ int run_flash_agent(u32 flashaddr, void *data, size_t data_sz) {
 	if (swdp_ahb_read32(agent->load_addr + 16, (void*) &agent->data_addr, 4)) {
 		goto fail;
 	}
+	memcpy(resident.info, &agent->data_addr, sizeof(resident.info));
+	resident.gen = target_gen;
+
+ready:
 	xprintf(XCORE, "agent %d @%08x, buffer %dK @%08x, flash %dK @%08x\n",
 		agent_sz, agent->load_addr,
 		agent->data_size / 1024, agent->data_addr,
 		agent->flash_size / 1024, agent->flash_addr);
 
+	if (agent->flags & FLAG_SERVICE) {
+		agent_service_start(agent);
+	}
+	flash_query_geometry(agent);
+
 	if ((flashaddr == 0) && (data == NULL) && (data_sz == 0xFFFFFFFF)) {
 		// erase all
 		flashaddr = agent->flash_addr;
@@ -838,43 +1403,27 @@ int run_flash_agent(u32 flashaddr, void *data, size_t data_sz) {
 
 	if (data == NULL) {
 		// erase
-		if (invoke(agent->load_addr, agent->erase, flashaddr, data_sz, 0, 0)) {
-			xprintf(XCORE, "failed to erase %d bytes at %08x\n", data_sz, flashaddr);
+		if (flash_erase(agent, flashaddr, data_sz)) {
 			goto fail;
 		}
 	} else {
 		// write
-		u8 *ptr = (void*) data;
-		u32 xfer;
 		xprintf(XCORE, "flashing %d bytes at %08x...\n", data_sz, flashaddr);
-		if (invoke(agent->load_addr, agent->erase, flashaddr, data_sz, 0, 0)) {
-			xprintf(XCORE, "failed to erase %d bytes at %08x\n", data_sz, flashaddr);
+		if (flash_image(agent, flashaddr, data, data_sz)) {
 			goto fail;
 		}
-		while (data_sz > 0) {
-			if (data_sz > agent->data_size) {
-				xfer = agent->data_size;
-			} else {
-				xfer = data_sz;
-			}
-			if (swdp_ahb_write32(agent->data_addr, (void*) ptr, xfer / 4)) {
-				xprintf(XCORE, "download to %08x failed\n", agent->data_addr);
-				goto fail;
-			}
-			if (invoke(agent->load_addr, agent->write,
-				flashaddr, agent->data_addr, xfer, 0)) {
-				xprintf(XCORE, "failed to flash %d bytes to %08x\n", xfer, flashaddr);
-				goto fail;
-			}
-			ptr += xfer;
-			data_sz -= xfer;
-			flashaddr += xfer;
-		}
 	}
 
+	agent_service_stop(agent);
+	memcache_flush();
 	if (data) free(data);
 	return 0;
 fail:
+	if (agent) {
+		agent_service_stop(agent);
+	}
+	resident.gen = 0;
+	memcache_flush();
 	if (data) free(data);
 	return -1;
 }
@@ -926,11 +1475,14 @@ int do_log(int argc, param *argv) {
 
 int do_finfo(int argc, param *argv) {
 	u32 cfsr = 0, hfsr = 0, dfsr = 0, mmfar = 0, bfar = 0;
-	swdp_ahb_read(CFSR, &cfsr);
-	swdp_ahb_read(HFSR, &hfsr);
-	swdp_ahb_read(DFSR, &dfsr);
-	swdp_ahb_read(MMFAR, &mmfar);
-	swdp_ahb_read(BFAR, &bfar);
+	debug_batch b;
+	debug_batch_init(&b);
+	debug_batch_rd_32(&b, CFSR, &cfsr);
+	debug_batch_rd_32(&b, HFSR, &hfsr);
+	debug_batch_rd_32(&b, DFSR, &dfsr);
+	debug_batch_rd_32(&b, MMFAR, &mmfar);
+	debug_batch_rd_32(&b, BFAR, &bfar);
+	debug_batch_commit(&b);
 
 	xprintf(XDATA, "CFSR %08x  MMFAR %08x\n", cfsr, mmfar);
 	xprintf(XDATA, "HFSR %08x   BFAR %08x\n", hfsr, bfar);
@@ -963,13 +1515,141 @@ int do_finfo(int argc, param *argv) {
 	if (hfsr & HFSR_DEBUGEVT)	xprintf(XDATA, ">HF: Debug Event\n");
 
 	// clear sticky fault bits
-	swdp_ahb_write(CFSR, CFSR_ALL);
-	swdp_ahb_write(HFSR, HFSR_ALL);
+	debug_batch_wr_32(&b, CFSR, CFSR_ALL);
+	debug_batch_wr_32(&b, HFSR, HFSR_ALL);
+	debug_batch_commit(&b);
 	return 0;
 }
 
 extern int swdp_step_no_ints;
 
+int do_stats(int argc, param *argv) {
+	if (argc > 0) {
+		if (!strcmp(argv[0].s, "reset")) {
+			swdp_stats_reset();
+			return 0;
+		}
+		xprintf(XCORE, "usage: stats [reset]\n");
+		return -1;
+	}
+	swdp_stats_dump();
+	return 0;
+}
+
+int do_probe(int argc, param *argv) {
+	if (argc == 0) {
+		swdp_probe_list();
+		return 0;
+	}
+	if (!strcmp(argv[0].s, "sim")) {
+		if (swdp_open_sim()) {
+			return -1;
+		}
+	} else if (swdp_probe_select(argv[0].s)) {
+		return -1;
+	}
+	// cached registers and memory belong to the previous target
+	swdp_core_cache_invalidate();
+	memcache_flush();
+	target_gen++;
+	xprintf(XDATA, "probe: %s\n", swdp_probe_serial());
+	return 0;
+}
+
+int do_jtagchain(int argc, param *argv) {
+	return jtag_chain_info((argc > 0) && !strcmp(argv[0].s, "rescan"));
+}
+
+int do_capture(int argc, param *argv) {
+	if (argc == 0) {
+		capture_status();
+		return 0;
+	}
+	if (!strcmp(argv[0].s, "stop")) {
+		capture_close();
+		return 0;
+	}
+	// default to a 16MB ring
+	return swdp_capture_start(argv[0].s, (argc > 1) ? argv[1].n : 0x1000000);
+}
+
+int do_sim(int argc, param *argv) {
+	if (argc == 0) {
+		sim_status();
+		return 0;
+	}
+	if (!strcmp(argv[0].s, "latency") && (argc == 2)) {
+		sim_set_latency(argv[1].n);
+	} else if (!strcmp(argv[0].s, "errors") && (argc > 1)) {
+		sim_set_errors(argv[1].n, (argc > 2) ? argv[2].n : 0);
+	} else if (!strcmp(argv[0].s, "wrap") && (argc == 2) &&
+		(argv[1].n >= 0x400) && !(argv[1].n & (argv[1].n - 1))) {
+		sim_set_wrap(argv[1].n);
+	} else {
+		xprintf(XCORE, "usage: sim [latency <us>|errors <err> [every]|wrap <bytes>]\n");
+		return -1;
+	}
+	return 0;
+}
+
+int do_wrapsize(int argc, param *argv) {
+	if (argc > 0) {
+		if (!strcmp(argv[0].s, "auto")) {
+			swdp_set_wrapsize(0);
+		} else if ((argv[0].n >= 0x400) && !(argv[0].n & (argv[0].n - 1))) {
+			swdp_set_wrapsize(argv[0].n);
+		} else {
+			xprintf(XCORE, "usage: wrapsize [auto|<bytes>]\n");
+			return -1;
+		}
+	}
+	xprintf(XDATA, "wrapsize: %x\n", swdp_get_wrapsize());
+	return 0;
+}
+int do_regcache(int argc, param *argv) {
+	unsigned hits, misses;
+	u32 valid;
+	if (argc > 0) {
+		if (!strcmp(argv[0].s, "reset")) {
+			swdp_core_cache_reset_stats();
+		} else if (!strcmp(argv[0].s, "flush")) {
+			swdp_core_cache_invalidate();
+		} else {
+			xprintf(XCORE, "usage: regcache [reset|flush]\n");
+			return -1;
+		}
+		return 0;
+	}
+	swdp_core_cache_stats(&hits, &misses, &valid);
+	xprintf(XDATA, "regcache: %u hits, %u misses, valid %08x\n", hits, misses, valid);
+	return 0;
+}
+
+int do_memcache(int argc, param *argv) {
+	if (argc == 0) {
+		memcache_dump();
+		return 0;
+	}
+	if (!strcmp(argv[0].s, "flush")) {
+		memcache_flush();
+		return 0;
+	}
+	if (!strcmp(argv[0].s, "clear")) {
+		memcache_clear_regions();
+		return 0;
+	}
+	if (argc == 3) {
+		if (!strcmp(argv[0].s, "cache")) {
+			return memcache_region(argv[1].n, argv[2].n, 1);
+		}
+		if (!strcmp(argv[0].s, "volatile")) {
+			return memcache_region(argv[1].n, argv[2].n, 0);
+		}
+	}
+	xprintf(XCORE, "usage: memcache [flush|clear|cache <addr> <size>|volatile <addr> <size>]\n");
+	return -1;
+}
+
 int do_maskints(int argc, param *argv) {
 	if (argc != 1) {
 		xprintf(XCORE, "usage: maskints [on|off|always]\n");
@@ -1039,6 +1719,7 @@ int do_wconsole(int argc, param *argv) {
 struct debugger_command debugger_commands[] = {
 	{ "exit",	"", do_exit,		"" },
 	{ "attach",	"", do_attach,		"attach/reattach to sw-dp" },
+	{ "dp",		"", do_dp,		"list or switch multi-drop DPs [name|targetsel]" },
 	{ "regs",	"", do_regs,		"show cpu registers" },
 	{ "finfo",	"", do_finfo,		"Fault Information" },
 	{ "stop",	"", do_stop,		"halt cpu" },
@@ -1046,6 +1727,7 @@ struct debugger_command debugger_commands[] = {
 	{ "go",		"", do_resume,		"resume cpu" },
 	{ "dw",		"", do_dw,		"dump words" },
 	{ "db",		"", do_db,		"dump bytes" },
+	{ "dh",		"", do_dh,		"dump halfwords" },
 	{ "dr",		"", do_dr,		"dump register" },
 	{ "wr",		"", do_wr,		"write register" },
 	{ "download",	"", do_download,	"download file to device" },
@@ -1061,10 +1743,19 @@ struct debugger_command debugger_commands[] = {
 	{ "watch-off",	"", do_watch_off,	"disable watchpoint" },
 	{ "log",	"", do_log,		"enable/disable logging" },
 	{ "maskints",	"", do_maskints,	"enable/disable IRQ mask during step" },
+	{ "probe",	"", do_probe,		"list probes or switch to one [serial|sim|tcp:host:port|unix:path]" },
+	{ "sim",	"", do_sim,		"simulated probe settings" },
+	{ "capture",	"", do_capture,		"record probe traffic [<file> [size]|stop]" },
+	{ "stats",	"", do_stats,		"swd link statistics [reset]" },
+	{ "jtagchain",	"", do_jtagchain,	"show the JTAG scan chain [rescan]" },
+	{ "wrapsize",	"", do_wrapsize,	"TAR auto-increment size [auto|<bytes>]" },
+	{ "regcache",	"", do_regcache,	"register cache stats [reset|flush]" },
+	{ "memcache",	"", do_memcache,	"memory cache regions and stats" },
 	{ "print",	"", do_print,		"print numeric arguments" },
 	{ "echo",	"", do_echo,		"echo command line" },
 	{ "bootloader", "", do_bootloader,	"reboot into bootloader" },
 	{ "setclock",	"", do_setclock,	"set SWD clock rate (khz)" },
+	{ "autoclock",	"", do_autoclock,	"find fastest SWD clock, for this session [ram-addr [max-khz]]" },
 	{ "swoclock",	"", do_swoclock,	"set SWO clock rate (khz)" },
 	{ "arch",	"", do_setarch,		"set architecture for flash agent" },
 	{ "threads",	"", do_threads,		"thread dump" },
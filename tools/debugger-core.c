@@ -33,6 +33,7 @@
 #include "rswdp.h"
 
 #include "websocket.h"
+#include "socket.h"
 
 #define DHCSR_C_DEBUGEN		(1 << 0)
 #define DHCSR_C_HALT		(1 << 1)
@@ -96,6 +97,8 @@ void debugger_lock() {
 		// way too noisy if the link goes down
 		xprintf("SWD ERROR persists. Attempting link reset.\n");
 #endif
+		swdp_core_cache_invalidate();
+		memcache_flush();
 		swdp_reset();
 	}
 	swd_verbose = 1;
@@ -121,7 +124,6 @@ void *debugger_monitor(void *arg) {
 }
 
 void gdb_server(int fd);
-int socket_listen_tcp(unsigned port);
 
 void *gdb_listener(void *arg) {
 	int fd;
@@ -606,7 +608,157 @@ debug_transport DUMMY_TRANSPORT = {
 	.mem_wr_32 = (void*) _fail,
 	.mem_rd_32_c = (void*) _fail,
 	.mem_wr_32_c = (void*) _fail,
+	.batch = (void*) _fail,
+	.mem_rd_c = (void*) _fail,
+	.mem_wr_c = (void*) _fail,
 };
 
 debug_transport *ACTIVE_TRANSPORT = &SWDP_TRANSPORT;
 
+void debug_batch_init(debug_batch *b) {
+	b->count = 0;
+	b->status = 0;
+}
+
+static int _batch_generic(debug_batch_op *op, unsigned count) {
+	while (count-- > 0) {
+		if (op->op == BATCH_WR) {
+			if (mem_wr_32(op->addr, op->value)) return -1;
+		} else {
+			if (mem_rd_32(op->addr, op->out)) return -1;
+		}
+		op++;
+	}
+	return 0;
+}
+
+static void debug_batch_flush(debug_batch *b) {
+	int r;
+	if (b->count == 0) {
+		return;
+	}
+	if (b->status == 0) {
+		if (ACTIVE_TRANSPORT->batch) {
+			r = ACTIVE_TRANSPORT->batch(b->ops, b->count);
+		} else {
+			r = _batch_generic(b->ops, b->count);
+		}
+		if (r) {
+			b->status = -1;
+		}
+	}
+	b->count = 0;
+}
+
+void debug_batch_rd_32(debug_batch *b, u32 addr, u32 *value) {
+	debug_batch_op *op;
+	if (b->count == DEBUG_BATCH_MAX) {
+		debug_batch_flush(b);
+	}
+	op = b->ops + b->count++;
+	op->op = BATCH_RD;
+	op->addr = addr;
+	op->out = value;
+}
+
+void debug_batch_wr_32(debug_batch *b, u32 addr, u32 value) {
+	debug_batch_op *op;
+	if (b->count == DEBUG_BATCH_MAX) {
+		debug_batch_flush(b);
+	}
+	op = b->ops + b->count++;
+	op->op = BATCH_WR;
+	op->addr = addr;
+	op->value = value;
+}
+
+int debug_batch_commit(debug_batch *b) {
+	int r;
+	debug_batch_flush(b);
+	r = b->status;
+	b->status = 0;
+	return r;
+}
+
+
+// fallback for transports without sized access: move the
+// whole words covering the range (read-modify-write on writes)
+static int _mem_rw_c_generic(u32 addr, void *data, int count, unsigned size, int wr) {
+	u32 base = addr & ~3;
+	u32 words = ((addr + count * size + 3) & ~3) - base;
+	u32 *buf;
+	int r = -1;
+
+	words /= 4;
+	if ((buf = malloc(words * 4)) == NULL) {
+		return -1;
+	}
+	if (mem_rd_32_c(base, buf, words)) {
+		goto done;
+	}
+	if (wr) {
+		memcpy(((u8*) buf) + (addr & 3), data, count * size);
+		r = mem_wr_32_c(base, buf, words);
+	} else {
+		memcpy(data, ((u8*) buf) + (addr & 3), count * size);
+		r = 0;
+	}
+done:
+	free(buf);
+	return r;
+}
+
+static int mem_size_ok(u32 addr, int count, unsigned size) {
+	if ((size != 1) && (size != 2) && (size != 4)) {
+		return 0;
+	}
+	return ((addr & (size - 1)) == 0) && (count > 0);
+}
+
+int mem_rd_c(u32 addr, void *data, int count, unsigned size) {
+	if (!mem_size_ok(addr, count, size)) {
+		return -1;
+	}
+	if (ACTIVE_TRANSPORT->mem_rd_c) {
+		return ACTIVE_TRANSPORT->mem_rd_c(addr, data, count, size);
+	} else {
+		return _mem_rw_c_generic(addr, data, count, size, 0);
+	}
+}
+
+int mem_wr_c(u32 addr, const void *data, int count, unsigned size) {
+	if (!mem_size_ok(addr, count, size)) {
+		return -1;
+	}
+	if (ACTIVE_TRANSPORT->mem_wr_c) {
+		return ACTIVE_TRANSPORT->mem_wr_c(addr, data, count, size);
+	} else {
+		return _mem_rw_c_generic(addr, (void*) data, count, size, 1);
+	}
+}
+
+int mem_wr_bytes(u32 addr, const void *data, u32 len) {
+	const u8 *p = data;
+	u32 xfer;
+
+	while (len > 0) {
+		if ((addr & 1) || (len == 1)) {
+			xfer = 1;
+		} else if ((addr & 2) || (len < 4)) {
+			xfer = 2;
+		} else {
+			xfer = 4;
+		}
+		if (xfer == 4) {
+			u32 count = len / 4;
+			if (mem_wr_c(addr, p, count, 4)) return -1;
+			xfer = count * 4;
+		} else {
+			if (mem_wr_c(addr, p, 1, xfer)) return -1;
+		}
+		addr += xfer;
+		p += xfer;
+		len -= xfer;
+	}
+	return 0;
+}
@@ -35,6 +35,10 @@ unsigned log_flags = 0;
 void linenoiseInit(void);
 
 static const char *scriptfile = NULL;
+static const char *serial = NULL;
+static const char *replay = NULL;
+static const char *remote = NULL;
+static int sim = 0;
 
 void gdb_console_puts(const char *msg);
 
@@ -55,7 +59,7 @@ static void handler(int n) {
 }
 
 static void usage(int argc, char **argv) {
-	fprintf(stderr, "usage: %s [-h] [-f script]\n", argv[0]);
+	fprintf(stderr, "usage: %s [-h] [-f script] [-s serial] [-R host:port|unix:path] [-r capture] [--sim]\n", argv[0]);
 
 	exit(1);
 }
@@ -63,6 +67,7 @@ static void usage(int argc, char **argv) {
 int main(int argc, char **argv) {
 	char lastline[1024];
 	char *line;
+	int pico = 0;
 
 	/* args */
 	for(;;) {
@@ -73,10 +78,14 @@ int main(int argc, char **argv) {
 			{"help", 0, 0, 'h'},
 			{"script", 1, 0, 'f'},
 			{"pico", 0, 0, 'p'},
+			{"serial", 1, 0, 's'},
+			{"remote", 1, 0, 'R'},
+			{"replay", 1, 0, 'r'},
+			{"sim", 0, 0, 'S'},
 			{0, 0, 0, 0},
 		};
 
-		c = getopt_long(argc, argv, "f:h", long_options, &option_index);
+		c = getopt_long(argc, argv, "f:hs:R:r:", long_options, &option_index);
 		if(c == -1)
 			break;
 
@@ -88,7 +97,19 @@ int main(int argc, char **argv) {
 				usage(argc, argv);
 				break;
 			case 'p':
-				debug_target("pico");
+				pico = 1;
+				break;
+			case 's':
+				serial = optarg;
+				break;
+			case 'R':
+				remote = optarg;
+				break;
+			case 'r':
+				replay = optarg;
+				break;
+			case 'S':
+				sim = 1;
 				break;
 			default:
 				usage(argc, argv);
@@ -98,10 +119,25 @@ int main(int argc, char **argv) {
 
 	lastline[0] = 0;
 
-	if (swdp_open()) {
+	if (replay) {
+		if (swdp_open_replay(replay)) {
+			return -1;
+		}
+	} else if (sim) {
+		if (swdp_open_sim()) {
+			return -1;
+		}
+	} else if (remote) {
+		if (swdp_open_remote(remote)) {
+			return -1;
+		}
+	} else if (swdp_open(serial)) {
 		fprintf(stderr,"could not find device\n");
 		return -1;
 	}
+	if (pico) {
+		debug_target("pico");
+	}
 
 	signal(SIGINT, handler);
 
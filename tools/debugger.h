@@ -82,6 +82,28 @@ extern struct debugger_command debugger_commands[];
 int read_register(const char *name, u32 *value);
 int read_memory_word(u32 addr, u32 *value);
 
+/* a batch of memory accesses, issued to the target in as few
+ * transport transactions as possible.  results of reads are not
+ * valid until debug_batch_commit() returns successfully.
+ */
+#define DEBUG_BATCH_MAX		128
+
+#define BATCH_RD		0
+#define BATCH_WR		1
+
+typedef struct debug_batch_op {
+	u32 op;
+	u32 addr;
+	u32 value;
+	u32 *out;
+} debug_batch_op;
+
+typedef struct debug_batch {
+	unsigned count;
+	int status;
+	debug_batch_op ops[DEBUG_BATCH_MAX];
+} debug_batch;
+
 typedef struct debug_transport {
 	// attempt to establish connection to target
 	int (*attach)(void);
@@ -101,6 +123,16 @@ typedef struct debug_transport {
 	// multiple 32bit memory access
 	int (*mem_rd_32_c)(u32 addr, u32 *data, int count);
 	int (*mem_wr_32_c)(u32 addr, u32 *data, int count);
+
+	// issue a list of 32bit memory accesses in order
+	// optional, falls back to mem_rd_32 / mem_wr_32
+	int (*batch)(debug_batch_op *op, unsigned count);
+
+	// multiple 8, 16, or 32bit memory access (size in bytes)
+	// addr must be size aligned, data is in target byte order
+	// optional, falls back to (read-modify-write of) whole words
+	int (*mem_rd_c)(u32 addr, void *data, int count, unsigned size);
+	int (*mem_wr_c)(u32 addr, const void *data, int count, unsigned size);
 } debug_transport;
 
 extern debug_transport *ACTIVE_TRANSPORT;
@@ -127,6 +159,28 @@ static inline int mem_wr_32_c(u32 addr, u32 *data, int count) {
 	return ACTIVE_TRANSPORT->mem_wr_32_c(addr, data, count);
 }
 
+/* provided by debugger-core.c */
+void debug_batch_init(debug_batch *b);
+void debug_batch_rd_32(debug_batch *b, u32 addr, u32 *value);
+void debug_batch_wr_32(debug_batch *b, u32 addr, u32 value);
+// issue any queued accesses, returns nonzero if any access failed
+int debug_batch_commit(debug_batch *b);
+
+// sized memory access, see debug_transport.mem_rd_c
+int mem_rd_c(u32 addr, void *data, int count, unsigned size);
+int mem_wr_c(u32 addr, const void *data, int count, unsigned size);
+// write len bytes using the widest aligned accesses possible
+int mem_wr_bytes(u32 addr, const void *data, u32 len);
+
+/* provided by memcache.c */
+// like mem_rd_32_c, but served from the host cache where allowed
+int memcache_read32(u32 addr, u32 *data, int count);
+void memcache_invalidate(u32 addr, u32 len);
+void memcache_flush(void);
+int memcache_region(u32 base, u32 size, int cacheable);
+void memcache_clear_regions(void);
+void memcache_dump(void);
+
 extern debug_transport DUMMY_TRANSPORT;
 extern debug_transport SWDP_TRANSPORT;
 extern debug_transport JTAG_TRANSPORT;
@@ -348,39 +348,18 @@ static void handle_set(struct gdbcnxn *gc, char *cmd, char *args) {
 // an aligned multiword write, followed by a read-modify-write.
 // (as necessary)
 void write_memory(u32 addr, unsigned char *data, int len) {
-	u32 x;
+	u32 x = 0;
 
 	if (len < 1) {
 		return;
 	}
-
-	if (addr & 3) {
-		int offset = (addr & 3);
-		int count = 4 - offset;
-		if (count > len) {
-			count = len;
-		}
-		swdp_ahb_read(addr & (~3), &x);
-		memcpy(((char*) &x) + offset, data, count);
-		swdp_ahb_write(addr & (~3), x);
-		len -= count;
-		data += count;
-		addr += count;
-	}
-
-	if (len > 3) {
-		int count = (4 * (len / 4));
-		swdp_ahb_write32(addr, (void*) data, len / 4);
-		len -= count;
-		data += count;
-		addr += count;
+	if (len == 4) {
+		memcpy(&x, data, 4);
 	}
+	swdp_core_cache_check_write(addr, len, x);
+	memcache_invalidate(addr, len);
 
-	if (len > 0) {
-		swdp_ahb_read(addr, &x);
-		memcpy(&x, data, len);
-		swdp_ahb_write(addr, x);
-	}
+	mem_wr_bytes(addr, data, len);
 }
 
 // bit 1 in each romtable entry indicates peripheral is present
@@ -407,6 +386,7 @@ static u32 bp_addr[MAXBP] = { 0, };
 static u32 bp_state[MAXBP] = { 0, };
 
 int handle_flashpatch(int add, u32 addr, u32 kind) {
+	debug_batch b;
 	u32 x;
 	int n;
 	if (swdp_ahb_read(ROMTAB_FPB, &x)) {
@@ -453,14 +433,16 @@ int handle_flashpatch(int add, u32 addr, u32 kind) {
 	}
 	return -1;
 add1:
-	swdp_ahb_write(FP_CTRL,3);
+	debug_batch_init(&b);
+	debug_batch_wr_32(&b, FP_CTRL,3);
 	if (addr & 2) {
 		// breakpoint on low half-word, enable
-		swdp_ahb_write(FP_COMP(n), 0x80000001 | (addr & 0x1FFFFFFC));
+		debug_batch_wr_32(&b, FP_COMP(n), 0x80000001 | (addr & 0x1FFFFFFC));
 	} else {
 		// breakpoint on high half-word, enable
-		swdp_ahb_write(FP_COMP(n), 0x40000001 | (addr & 0x1FFFFFFC));
+		debug_batch_wr_32(&b, FP_COMP(n), 0x40000001 | (addr & 0x1FFFFFFC));
 	}
+	debug_batch_commit(&b);
 	fp_state[n] = 1;
 	fp_addr[n] = addr;
 add0:
@@ -622,7 +604,7 @@ void handle_command(struct gdbcnxn *gc, unsigned char *cmd) {
 		if (n > 1024) {
 			n = 1024;
 		}
-		swdp_ahb_read32(x & (~3), tmp.w, ((n + 3) & (~3)) / 4);
+		memcache_read32(x & (~3), tmp.w, ((n + 3) & (~3)) / 4);
 		gdb_puthex(gc, tmp.b + (x & 3), n);
 		break;
 	// M hexaddr , hexcount : hexbytes
@@ -662,11 +644,13 @@ void handle_command(struct gdbcnxn *gc, unsigned char *cmd) {
 			xprintf(XGDB, "gdb: attempting to write to inactive registers\n");
 			break;
 		}
+		u32 regs[19];
 		int len = hextobin(gc->rxbuf, (char*) cmd + 1, MAXPKT);
-		for (n = 0; n < len / 4; n++) {
-			memcpy(&x, gc->rxbuf + (n * 4), sizeof(x));
-			swdp_core_write(n, x);
+		if (len > sizeof(regs)) {
+			len = sizeof(regs);
 		}
+		memcpy(regs, gc->rxbuf, len);
+		swdp_core_write_regs((1u << (len / 4)) - 1, regs);
 		gdb_puts(gc, "OK");
 		break;
 	}
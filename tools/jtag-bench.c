@@ -0,0 +1,123 @@
+/* jtag-bench.c
+ *
+ * Copyright 2015 Brian Swetland <swetland@frotz.net>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Checks jtag_pack() and jtag_unpack() against the bit at a time
+// packing and unpacking they replaced, then times both.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <fw/types.h>
+#include "jtag.h"
+
+#define countof(x) (sizeof(x) / sizeof((x)[0]))
+
+static void pack_bitwise(u32 *w, unsigned off, unsigned count, u64 bits) {
+	while (count > 0) {
+		w[off >> 5] |= (bits & 1) << (off & 31);
+		bits >>= 1;
+		count--;
+		off++;
+	}
+}
+
+static u64 unpack_bitwise(const u32 *w, unsigned off, unsigned count) {
+	unsigned bit = 0;
+	u64 x = 0;
+	while (count > 0) {
+		x |= ((u64) ((w[off >> 5] >> (off & 31)) & 1)) << bit;
+		off++;
+		bit++;
+		count--;
+	}
+	return x;
+}
+
+static long long now(void) {
+	struct timeval tv;
+	gettimeofday(&tv, 0);
+	return ((long long) tv.tv_usec) + ((long long) tv.tv_sec) * 1000000LL;
+}
+
+// a mix of DAP sized scans
+static const unsigned sizes[] = { 3, 35, 1, 2, 4, 6, 3, 35, 2, 64, 7, 32 };
+
+int main(int argc, char **argv) {
+	u32 a[JTAG_MAX_WORDS], b[JTAG_MAX_WORDS];
+	u64 x, sum = 0;
+	long long t0, t1, t2;
+	unsigned i, n, off, scans = 0;
+	unsigned iterations = 10000;
+
+	if (argc > 1) {
+		iterations = strtoul(argv[1], NULL, 0);
+	}
+	if (iterations == 0) {
+		fprintf(stderr, "usage: jtag-bench [iterations]\n");
+		return -1;
+	}
+
+	// check both give the same bitstream and results
+	memset(a, 0, sizeof(a));
+	memset(b, 0, sizeof(b));
+	x = 0x0123456789ABCDEFULL;
+	for (n = 0, off = 0; off + 64 <= (JTAG_MAX_WORDS * 32); n++) {
+		unsigned count = sizes[n % countof(sizes)];
+		pack_bitwise(a, off, count, x);
+		jtag_pack(b, off, count, x);
+		if (jtag_unpack(b, off, count) != unpack_bitwise(a, off, count)) {
+			fprintf(stderr, "jtag-bench: unpack mismatch at bit %u\n", off);
+			return -1;
+		}
+		x = (x << 7) ^ (x >> 3) ^ n;
+		off += count;
+	}
+	if (memcmp(a, b, sizeof(a))) {
+		fprintf(stderr, "jtag-bench: pack mismatch\n");
+		return -1;
+	}
+
+	t0 = now();
+	for (i = 0; i < iterations; i++) {
+		memset(a, 0, sizeof(a));
+		for (n = 0, off = 0; off + 64 <= (JTAG_MAX_WORDS * 32); n++) {
+			unsigned count = sizes[n % countof(sizes)];
+			pack_bitwise(a, off, count, i + n);
+			sum += unpack_bitwise(a, off, count);
+			off += count;
+		}
+		scans += n;
+	}
+	t1 = now();
+	for (i = 0; i < iterations; i++) {
+		memset(b, 0, sizeof(b));
+		for (n = 0, off = 0; off + 64 <= (JTAG_MAX_WORDS * 32); n++) {
+			unsigned count = sizes[n % countof(sizes)];
+			jtag_pack(b, off, count, i + n);
+			sum -= jtag_unpack(b, off, count);
+			off += count;
+		}
+	}
+	t2 = now();
+
+	printf("jtag-bench: %u scans, bitwise %lld ns/scan, wordwise %lld ns/scan%s\n",
+		scans, ((t1 - t0) * 1000) / scans, ((t2 - t1) * 1000) / scans,
+		sum ? " (MISMATCH)" : "");
+	return sum ? -1 : 0;
+}
@@ -23,6 +23,7 @@
 #include "debugger.h"
 #include "jtag.h"
 #include "dap-registers.h"
+#include "rswdp.h"
 
 #define CSW_ERRORS (DPCSW_STICKYERR | DPCSW_STICKYCMP | DPCSW_STICKYORUN)
 #define CSW_ENABLES (DPCSW_CSYSPWRUPREQ | DPCSW_CDBGPWRUPREQ | DPCSW_ORUNDETECT)
@@ -303,55 +304,81 @@ static int jtag_error = 0;
 
 #include "ti-icepick.h"
 
-#define IDCODE_ARM_M3		0x4ba00477
 #define IPCODE_TI_ICEPICK	0x41611cc0
-#define IDCODE_CC1310		0x2b9be02f
-#define IDCODE_CC2650		0x8b99a02f
 
-int connect_ti(void) {
-	u64 x0, x1;
-	int retry = 5;
-	jtag_txn t;
+// Where the DAP sits on each probe's scan chain, and how it got
+// there, so that attaching again only has to check it is still so.
+struct jtag_topology {
+	int valid;
+	char serial[64];
+	jtag_chain chain;
+	unsigned dap;
+	// TI parts come up with the chain in 2-pin cJTAG mode and only
+	// an ICEPick on it, which must be told to add the DAP
+	int cjtag;
+	int icepick;
+	jtag_chain boot;
+};
 
-	while (retry > 0) {
-		jtag_txn_init(&t);
-		jtag_any_to_rti(&t);
+#define TOPOLOGY_MAX 8
 
-		// Enable 4-wire JTAG
-		jtag_ir(&t, 6, 0x3F);
-		jtag_cjtag_open(&t);
-		jtag_cjtag_cmd(&t, 2, 9);
-		jtag_ir(&t, 6, 0x3F);
+static struct jtag_topology topology[TOPOLOGY_MAX];
 
-		// sit in IDLE for a bit (not sure if useful)
-		jtag_txn_append(&t, 64, 0, 0, NULL);
+// the chain of the probe last attached
+static struct jtag_topology *dap_topology = NULL;
 
-		// Read IDCODE and IPCODE
-		jtag_ir(&t, 6, IP_IR_IDCODE);
-		jtag_dr(&t, 32, 0x00000000, &x0);
-		jtag_ir(&t, 6, IP_IR_IPCODE);
-		jtag_dr(&t, 32, 0x00000000, &x1);
-		jtag_txn_exec(&t);
+static void dap_open(DAP *dap, jtag_txn *t) {
+	if (dap_topology) {
+		jtag_chain_select(&dap_topology->chain, dap_topology->dap, t);
+		dap_init(dap, t, t->ir_pre, t->ir_post, t->dr_pre, t->dr_post);
+	} else {
+		// the ICEPick path of the CC13xx/CC26xx
+		dap_init(dap, t, 0, 6, 0, 1);
+	}
+}
 
-		if (x1 == IPCODE_TI_ICEPICK) {
-			if (x0 == IDCODE_CC1310) {
-				break;
-			}
-			if (x0 == IDCODE_CC2650) {
-				break;
-			}
-			xprintf(XCORE, "wat!\n");
-		}
-		retry--;
+static int is_arm_dp(u32 idcode) {
+	return (idcode & 0x0FF00FFF) == 0x0BA00477;
+}
+
+static void ti_cjtag_to_jtag(jtag_txn *t) {
+	jtag_any_to_rti(t);
+
+	// Enable 4-wire JTAG
+	jtag_ir(t, 6, 0x3F);
+	jtag_cjtag_open(t);
+	jtag_cjtag_cmd(t, 2, 9);
+	jtag_ir(t, 6, 0x3F);
+
+	// sit in IDLE for a bit (not sure if useful)
+	jtag_txn_append(t, 64, 0, 0, NULL);
+}
+
+static int ti_is_icepick(jtag_chain *c, unsigned n) {
+	jtag_txn t;
+	u64 x = 0;
+	// TI manufacturer id, and the ICEPick IR length
+	if (((c->idcode[n] & 0xFFF) != 0x02F) || (c->irlen[n] != 6)) {
+		return 0;
 	}
-	if (retry == 0) {
-		//xprintf(XCORE, "cannot connect (%08x %08x)\n", (u32)x0, (u32)x1);
-		return -1;
+	jtag_txn_init(&t);
+	t.state = JTAG_IDLE;
+	jtag_chain_select(c, n, &t);
+	jtag_ir(&t, 6, IP_IR_IPCODE);
+	jtag_dr(&t, 32, 0x00000000, &x);
+	if (jtag_txn_exec(&t)) {
+		return 0;
 	}
-	xprintf(XSWD, "attach: IDCODE %08x %08x\n", (u32)x0, (u32)x1);
+	return x == IPCODE_TI_ICEPICK;
+}
+
+// the DAP joins the chain just ahead of (on the TDO side of) the ICEPick
+static int ti_route_dap(jtag_chain *c, unsigned n) {
+	jtag_txn t;
 
 	jtag_txn_init(&t);
 	t.state = JTAG_IDLE;
+	jtag_chain_select(c, n, &t);
 
 	// enable router access
 	jtag_ir(&t, 6, IP_IR_CONNECT);
@@ -368,33 +395,168 @@ int connect_ti(void) {
 
 	// idle for a few clocks to let the new TAP path settle
 	jtag_txn_append(&t, 8, 0, 0, NULL);
-	jtag_txn_exec(&t);
+	return jtag_txn_exec(&t);
+}
 
-#if 0
+static int dap_read_idcode(jtag_chain *c, unsigned n, u32 *idcode) {
+	jtag_txn t;
+	u64 x = 0;
 	jtag_txn_init(&t);
 	t.state = JTAG_IDLE;
-	t.ir_pre = 4;
-	t.dr_pre = 1;
-	jtag_ir(&t, 6, IP_IR_ROUTER);
-	jtag_dr(&t, 32, IP_RTR_WR | IP_RTR_BLK(IP_BLK_CONTROL) | IP_RTR_REG(IP_CTL_CONTROL) |
-		IP_RTR_VAL(IP_CTL_SYSTEM_RESET), NULL);
-	jtag_txn_exec(&t);
-#endif
+	jtag_chain_select(c, n, &t);
+	jtag_ir(&t, 4, DAP_IR_IDCODE);
+	jtag_dr(&t, 32, 0, &x);
+	if (jtag_txn_exec(&t)) {
+		return -1;
+	}
+	*idcode = x;
+	return 0;
+}
+
+// get the chain back to where discovery left it
+static int topology_restore(struct jtag_topology *tp) {
+	jtag_txn t;
+	u32 x;
 
-	// we should now be stable, try to read DAP IDCODE
 	jtag_txn_init(&t);
-	t.state = JTAG_IDLE;
-	t.ir_post = 6;
-	t.dr_post = 1;
-	jtag_ir(&t, 4, 0xE); // IDCODE
-	jtag_dr(&t, 32, 0, &x0);
-	jtag_txn_exec(&t);
-
-	if (x0 != IDCODE_ARM_M3) {
-		xprintf(XDATA, "cannot find DAP (%08x)\n", (u32)x0);
+	if (tp->cjtag) {
+		ti_cjtag_to_jtag(&t);
+	} else {
+		jtag_any_to_rti(&t);
+	}
+	if (jtag_txn_exec(&t)) {
+		return -1;
+	}
+	if ((tp->icepick >= 0) && ti_route_dap(&tp->boot, tp->icepick)) {
+		return -1;
+	}
+	if (dap_read_idcode(&tp->chain, tp->dap, &x)) {
+		return -1;
+	}
+	return (x == tp->chain.idcode[tp->dap]) ? 0 : -1;
+}
+
+static int topology_discover(struct jtag_topology *tp) {
+	jtag_chain *c = &tp->chain;
+	jtag_txn t;
+	unsigned n;
+	u32 x;
+
+	tp->cjtag = 0;
+	tp->icepick = -1;
+	if (jtag_chain_scan(c) || (c->count == 0)) {
+		// nothing sensible on 4-wire JTAG, try waking a TI part
+		jtag_txn_init(&t);
+		ti_cjtag_to_jtag(&t);
+		if (jtag_txn_exec(&t) || jtag_chain_scan(c) || (c->count == 0)) {
+			xprintf(XCORE, "jtag: no devices on the scan chain\n");
+			return -1;
+		}
+		tp->cjtag = 1;
+	}
+
+	for (n = 0; n < c->count; n++) {
+		if (is_arm_dp(c->idcode[n])) {
+			break;
+		}
+	}
+	if (n == c->count) {
+		for (n = 0; n < c->count; n++) {
+			if (ti_is_icepick(c, n)) {
+				break;
+			}
+		}
+		if ((n == c->count) || (c->count == JTAG_MAX_TAPS)) {
+			xprintf(XCORE, "jtag: no ARM DAP on the scan chain\n");
+			return -1;
+		}
+		tp->boot = *c;
+		tp->icepick = n;
+		if (ti_route_dap(&tp->boot, n)) {
+			return -1;
+		}
+		memmove(c->idcode + n + 1, c->idcode + n, (c->count - n) * sizeof(c->idcode[0]));
+		memmove(c->irlen + n + 1, c->irlen + n, (c->count - n) * sizeof(c->irlen[0]));
+		c->count++;
+		c->irlen[n] = 4;
+		c->irtotal += 4;
+		if (dap_read_idcode(c, n, &x) || !is_arm_dp(x)) {
+			xprintf(XCORE, "jtag: cannot find DAP behind ICEPick\n");
+			return -1;
+		}
+		c->idcode[n] = x;
+	}
+	tp->dap = n;
+	return 0;
+}
+
+static void topology_show(struct jtag_topology *tp) {
+	jtag_chain *c = &tp->chain;
+	unsigned n;
+	for (n = 0; n < c->count; n++) {
+		xprintf(XDATA, "TAP%d: IDCODE %08x  IR %d bits%s%s\n", n,
+			c->idcode[n], c->irlen[n],
+			(n == tp->dap) ? "  (DAP)" : "",
+			((tp->icepick >= 0) && (n == (tp->icepick + 1))) ? "  (ICEPick)" : "");
+	}
+}
+
+static struct jtag_topology *topology_find(const char *serial) {
+	unsigned n;
+	for (n = 0; n < TOPOLOGY_MAX; n++) {
+		if (topology[n].valid && !strcmp(topology[n].serial, serial)) {
+			return topology + n;
+		}
+	}
+	return NULL;
+}
+
+static int dap_find(void) {
+	const char *serial = swdp_probe_serial();
+	struct jtag_topology *tp;
+	unsigned n;
+
+	dap_topology = NULL;
+	if ((tp = topology_find(serial)) != NULL) {
+		if (topology_restore(tp) == 0) {
+			goto done;
+		}
+		xprintf(XSWD, "attach: JTAG chain changed, rescanning\n");
+	} else {
+		// a free slot, or the last one if there are none
+		for (n = 0; n < (TOPOLOGY_MAX - 1); n++) {
+			if (!topology[n].valid) {
+				break;
+			}
+		}
+		tp = topology + n;
+		snprintf(tp->serial, sizeof(tp->serial), "%s", serial);
+	}
+	// do not keep a half-discovered chain
+	tp->valid = 0;
+	if (topology_discover(tp)) {
 		return -1;
 	}
+	tp->valid = 1;
+	topology_show(tp);
+done:
+	dap_topology = tp;
+	return 0;
+}
 
+int jtag_chain_info(int forget) {
+	struct jtag_topology *tp = topology_find(swdp_probe_serial());
+	if (tp == NULL) {
+		xprintf(XDATA, "jtag: chain not scanned yet\n");
+	} else if (forget) {
+		// the next attach starts from scratch
+		tp->valid = 0;
+		if (dap_topology == tp) {
+			dap_topology = NULL;
+		}
+	} else {
+		topology_show(tp);
+	}
 	return 0;
 }
 
@@ -402,10 +564,10 @@ int _attach(void) {
 	jtag_txn t;
 	DAP dap;
 	jtag_error = -1;
-	if (connect_ti()) {
+	if (dap_find()) {
 		return -1;
 	}
-	dap_init(&dap, &t, 0, 6, 0, 1);
+	dap_open(&dap, &t);
 	if (dap_attach(&dap)) {
 		return -1;
 	}
@@ -420,7 +582,7 @@ static int _mem_rd_32(u32 addr, u32 *val) {
 	if ((addr & 3) || jtag_error) {
 		return -1;
 	}
-	dap_init(&dap, &t, 0, 6, 0, 1);
+	dap_open(&dap, &t);
 	jtag_error = dap_mem_rd32(&dap, 0, addr, val);
 	return jtag_error;
 }
@@ -431,47 +593,145 @@ static int _mem_wr_32(u32 addr, u32 val) {
 	if ((addr & 3) || jtag_error) {
 		return -1;
 	}
-	dap_init(&dap, &t, 0, 6, 0, 1);
+	dap_open(&dap, &t);
 	jtag_error = dap_mem_wr32(&dap, 0, addr, val);
 	return jtag_error;
 }
 
-static int _mem_rd_32_c(u32 addr, u32 *data, int count) {
+// words per block transfer batch, each a 35bit DRW scan, which
+// jtag_io() splits into as many probe txns as it needs
+#define BLOCK_BATCH_MAX 1024
+
+static int _batch(debug_batch_op *op, unsigned count) {
+	u64 u[DEBUG_BATCH_MAX];
 	jtag_txn t;
 	DAP dap;
-	if ((addr & 3) || jtag_error) {
+	unsigned i, n;
+
+	if (jtag_error) {
 		return -1;
 	}
-	dap_init(&dap, &t, 0, 6, 0, 1);
+	// check before queuing anything, since a txn must be executed
+	for (i = 0; i < count; i++) {
+		if (op[i].addr & 3) {
+			goto fail;
+		}
+	}
+	dap_open(&dap, &t);
 	while (count > 0) {
-		if (dap_mem_rd32(&dap, 0, addr, data)) {
-			jtag_error = -1;
-			return -1;
+		// all ops are on AP0 bank 0, so SELECT is written once
+		q_dap_ap_wr(&dap, 0, APACC_CSW,
+			0x23000000 | APCSW_DBGSWEN | APCSW_INCR_NONE | APCSW_SIZE32); //XXX
+		for (n = 0; (n < count) && (n < DEBUG_BATCH_MAX); n++) {
+			q_dap_ir_wr(&dap, DAP_IR_APACC);
+			q_dap_dr_io(&dap, 35, XPACC_WR(APACC_TAR, op[n].addr), NULL);
+			if (op[n].op == BATCH_WR) {
+				q_dap_dr_io(&dap, 35, XPACC_WR(APACC_DRW, op[n].value), NULL);
+			} else {
+				q_dap_dr_io(&dap, 35, XPACC_RD(APACC_DRW), NULL);
+				q_dap_ir_wr(&dap, DAP_IR_DPACC);
+				q_dap_dr_io(&dap, 35, XPACC_RD(DPACC_RDBUFF), u + n);
+			}
+		}
+		if (dap_commit(&dap)) {
+			goto fail;
+		}
+		count -= n;
+		for (i = 0; i < n; i++, op++) {
+			if (op->op == BATCH_RD) {
+				if (XPACC_STATUS(u[i]) != XPACC_OK) {
+					goto fail;
+				}
+				*op->out = u[i] >> 3;
+			}
 		}
-		addr += 4;
-		data++;
-		count--;
 	}
 	return 0;
+fail:
+	jtag_error = -1;
+	return -1;
 }
 
-static int _mem_wr_32_c(u32 addr, u32 *data, int count) {
+// block accesses auto-increment through TAR, and pack up to
+// BLOCK_BATCH_MAX DRW scans into each jtag txn with a single sticky
+// error check at the end.  CSW and TAR are written once, and TAR
+// again only at each 1K boundary, the most every MEM-AP must support.
+static int _mem_rw_c(u32 addr, u8 *data, int count, unsigned size, int wr) {
+	u64 u[BLOCK_BATCH_MAX];
+	u64 *pending;
 	jtag_txn t;
 	DAP dap;
-	if ((addr & 3) || jtag_error) {
+	u32 start = addr;
+	int i, n;
+
+	if (((size == 4) && (addr & 3)) || jtag_error) {
 		return -1;
 	}
-	dap_init(&dap, &t, 0, 6, 0, 1);
+	dap_open(&dap, &t);
+	q_dap_ap_wr(&dap, 0, APACC_CSW,
+		0x23000000 | APCSW_DBGSWEN | APCSW_INCR_SINGLE |
+		((size == 1) ? APCSW_SIZE8 :
+		((size == 2) ? APCSW_SIZE16 : APCSW_SIZE32))); //XXX
+	q_dap_ap_wr(&dap, 0, APACC_TAR, addr);
 	while (count > 0) {
-		if (dap_mem_wr32(&dap, 0, addr, *data)) {
-			jtag_error = -1;
-			return -1;
+		q_dap_ir_wr(&dap, DAP_IR_APACC);
+		// each scan returns the result of the read before it
+		pending = NULL;
+		for (n = 0; (n < count) && (n < BLOCK_BATCH_MAX); n++) {
+			u32 a = addr + n * size;
+			if (((a & 0x3FF) == 0) && (a != start)) {
+				q_dap_dr_io(&dap, 35, XPACC_WR(APACC_TAR, a), pending);
+				pending = NULL;
+			}
+			if (wr) {
+				u32 v = 0;
+				memcpy(&v, data + n * size, size);
+				v <<= 8 * (a & 3);
+				q_dap_dr_io(&dap, 35, XPACC_WR(APACC_DRW, v), NULL);
+			} else {
+				q_dap_dr_io(&dap, 35, XPACC_RD(APACC_DRW), pending);
+				pending = u + n;
+			}
 		}
-		addr += 4;
-		data++;
-		count--;
+		if (!wr) {
+			q_dap_ir_wr(&dap, DAP_IR_DPACC);
+			q_dap_dr_io(&dap, 35, XPACC_RD(DPACC_RDBUFF), pending);
+		}
+		if (dap_commit(&dap)) {
+			goto fail;
+		}
+		for (i = 0; (i < n) && !wr; i++) {
+			u32 v;
+			if (XPACC_STATUS(u[i]) != XPACC_OK) {
+				goto fail;
+			}
+			v = (u[i] >> 3) >> (8 * ((addr + i * size) & 3));
+			memcpy(data + i * size, &v, size);
+		}
+		addr += n * size;
+		data += n * size;
+		count -= n;
 	}
 	return 0;
+fail:
+	jtag_error = -1;
+	return -1;
+}
+
+static int _mem_rd_32_c(u32 addr, u32 *data, int count) {
+	return _mem_rw_c(addr, (void*) data, count, 4, 0);
+}
+
+static int _mem_wr_32_c(u32 addr, u32 *data, int count) {
+	return _mem_rw_c(addr, (void*) data, count, 4, 1);
+}
+
+static int _mem_rd_c(u32 addr, void *data, int count, unsigned size) {
+	return _mem_rw_c(addr, data, count, size, 0);
+}
+
+static int _mem_wr_c(u32 addr, const void *data, int count, unsigned size) {
+	return _mem_rw_c(addr, (void*) data, count, size, 1);
 }
 
 static int _clear_error(void) {
@@ -494,4 +754,7 @@ debug_transport JTAG_TRANSPORT = {
 	.mem_wr_32 = _mem_wr_32,
 	.mem_rd_32_c = _mem_rd_32_c,
 	.mem_wr_32_c = _mem_wr_32_c,
+	.batch = _batch,
+	.mem_rd_c = _mem_rd_c,
+	.mem_wr_c = _mem_wr_c,
 };
@@ -15,6 +15,7 @@
  * limitations under the License.
  */
 
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
@@ -36,49 +37,102 @@ static u64 ONES = 0xFFFFFFFFFFFFFFFFUL;
 
 void jtag_txn_init(jtag_txn *tx) {
 	memset(tx, 0, sizeof(jtag_txn));
+	tx->tms = tx->_tms;
+	tx->tdi = tx->_tdi;
+	tx->tdo = tx->_tdo;
+	tx->bits = tx->_bits;
+	tx->ptr = tx->_ptr;
+	tx->maxwords = JTAG_MAX_WORDS;
+	tx->maxresults = JTAG_MAX_RESULTS;
 	tx->state = JTAG_UNKNOWN;
 }
 
-int jtag_txn_exec(jtag_txn *t) {
-	unsigned n, off = 0;
-	int r;
-	if (t->status) {
-		return t->status;
+// move an array out of the txn (or grow it), zeroing the new space
+static void *jtag_grow(void *p, void *inline_p, unsigned oldsz, unsigned newsz) {
+	void *n;
+	if (p == inline_p) {
+		if ((n = malloc(newsz)) != NULL) {
+			memcpy(n, p, oldsz);
+		}
+	} else {
+		n = realloc(p, newsz);
+	}
+	if (n != NULL) {
+		memset(((u8*) n) + oldsz, 0, newsz - oldsz);
+	}
+	return n;
+}
+
+static void jtag_txn_grow(jtag_txn *t, unsigned count) {
+	unsigned words = (t->txc + count + 31) / 32;
+	if (words > t->maxwords) {
+		unsigned old = t->maxwords * sizeof(u32);
+		unsigned sz;
+		words = (words > (t->maxwords * 2)) ? words : (t->maxwords * 2);
+		sz = words * sizeof(u32);
+		if ((t->tms = jtag_grow(t->tms, t->_tms, old, sz)) == NULL) goto oops;
+		if ((t->tdi = jtag_grow(t->tdi, t->_tdi, old, sz)) == NULL) goto oops;
+		if ((t->tdo = jtag_grow(t->tdo, t->_tdo, old, sz)) == NULL) goto oops;
+		t->maxwords = words;
 	}
-	//xprintf(XCORE, "jtag exec %d bits\n", t->txc);
-	r = jtag_io(t->txc, t->tms, t->tdi, t->tdo);
+	if (t->rxc == t->maxresults) {
+		unsigned n = t->maxresults * 2;
+		if ((t->bits = jtag_grow(t->bits, t->_bits,
+			t->maxresults * sizeof(u8), n * sizeof(u8))) == NULL) goto oops;
+		if ((t->ptr = jtag_grow(t->ptr, t->_ptr,
+			t->maxresults * sizeof(u64*), n * sizeof(u64*))) == NULL) goto oops;
+		t->maxresults = n;
+	}
+	return;
+oops:
+	fprintf(stderr, "FATAL: jtag txn out of memory\n");
+	exit(1);
+}
+
+static void jtag_txn_free(jtag_txn *t) {
+	if (t->tms != t->_tms) free(t->tms);
+	if (t->tdi != t->_tdi) free(t->tdi);
+	if (t->tdo != t->_tdo) free(t->tdo);
+	if (t->bits != t->_bits) free(t->bits);
+	if (t->ptr != t->_ptr) free(t->ptr);
+	t->tms = t->_tms;
+	t->tdi = t->_tdi;
+	t->tdo = t->_tdo;
+	t->bits = t->_bits;
+	t->ptr = t->_ptr;
+	t->maxwords = JTAG_MAX_WORDS;
+	t->maxresults = JTAG_MAX_RESULTS;
+}
+
+static void jtag_txn_results(jtag_txn *t) {
+	unsigned n, off = 0;
 	for (n = 0; n < t->rxc; n++) {
-		unsigned count = t->bits[n];
 		if (t->ptr[n]) {
-			unsigned bit = 0;
-			u64 x = 0;
-			while (count > 0) {
-				x |= ((u64) ((t->tdo[off >> 5] >> (off & 31)) & 1)) << bit;
-				off++;
-				bit++;
-				count--;
-			}
-			*t->ptr[n] = x;
-		} else {
-			off += count;
+			*t->ptr[n] = jtag_unpack(t->tdo, off, t->bits[n]);
 		}
+		off += t->bits[n];
 	}
+}
+
+// scans of any length are fine, jtag_io() splits them as needed
+int jtag_txn_exec(jtag_txn *t) {
+	int r;
+	if ((r = t->status) == 0) {
+		//xprintf(XCORE, "jtag exec %d bits\n", t->txc);
+		r = jtag_io(t->txc, t->tms, t->tdi, t->tdo);
+		jtag_txn_results(t);
+	}
+	jtag_txn_free(t);
 	return r;
 }
 
 void jtag_txn_append(jtag_txn *t, unsigned count, u64 tms, u64 tdi, u64 *tdo) {
-	unsigned txc = t->txc;
-
-	if (txc == JTAG_MAX_RESULTS) {
-		xprintf(XCORE, "jtag append txn overflow\n");
-		t->status = -1;
-		return;
-	}
-	if ((count > 64) || ((JTAG_MAX_BITS - t->bitcount) < count)) {
+	if (count > 64) {
 		xprintf(XCORE, "jtag append bits overflow\n");
 		t->status = -1;
 		return;
 	}
+	jtag_txn_grow(t, count);
 	t->bitcount += count;
 
 //	xprintf(XCORE, "jtag append %2d bits %016lx %016lx\n", count, tms, tdi);
@@ -87,15 +141,9 @@ void jtag_txn_append(jtag_txn *t, unsigned count, u64 tms, u64 tdi, u64 *tdo) {
 	t->bits[t->rxc] = count;
 	t->rxc++;
 
-	while (count > 0) {
-		t->tms[txc >> 5] |= (tms & 1) << (txc & 31);
-		t->tdi[txc >> 5] |= (tdi & 1) << (txc & 31);
-		tms >>= 1;
-		tdi >>= 1;
-		count--;
-		txc++;
-	}
-	t->txc = txc;
+	jtag_pack(t->tms, t->txc, count, tms);
+	jtag_pack(t->tdi, t->txc, count, tdi);
+	t->txc += count;
 }
 
 void jtag_txn_move(jtag_txn *t, unsigned dst) {
@@ -284,3 +332,150 @@ void jtag_dr_p(jtag_txn *t, unsigned count, u64 dr, u64 *out) {
 }
 
 
+
+
+// IR lengths of parts whose IR capture bits are not enough to go on
+static unsigned jtag_irlen_known(u32 idcode) {
+	// ARM JTAG-DP
+	if ((idcode & 0x0FF00FFF) == 0x0BA00477) {
+		return 4;
+	}
+	return 0;
+}
+
+#define SCAN_DR_BITS	((JTAG_MAX_TAPS + 1) * 32)
+#define SCAN_IR_BITS	256
+
+// shift count bits in a Shift state, 32 at a time, optionally
+// leaving it (for Exit1) on the last one
+static void jtag_scan_shift(jtag_txn *t, unsigned count, u64 tdi, u64 *out, int last) {
+	while (count > 0) {
+		unsigned n = (count > 32) ? 32 : count;
+		count -= n;
+		jtag_txn_append(t, n, (last && !count) ? (1ULL << (n - 1)) : 0, tdi, out);
+		if (out) {
+			out++;
+		}
+	}
+}
+
+static unsigned scan_bit(const u64 *bits, unsigned n) {
+	return (bits[n >> 5] >> (n & 31)) & 1;
+}
+
+// The IR capture value always ends in 01, so each TAP's IR starts
+// with a 1 then a 0.  Known lengths are used where there are any,
+// otherwise the IR runs to the next 1,0 that leaves room for the rest.
+static int jtag_chain_irlen(jtag_chain *c, const u64 *cap) {
+	unsigned n, len, off = 0;
+
+	for (n = 0; n < c->count; n++) {
+		if ((off + 2 > c->irtotal) ||
+			(scan_bit(cap, off) != 1) || (scan_bit(cap, off + 1) != 0)) {
+			goto fail;
+		}
+		if ((len = jtag_irlen_known(c->idcode[n])) == 0) {
+			if (n == (c->count - 1)) {
+				len = c->irtotal - off;
+			} else {
+				for (len = 2; (off + len + 2) <= c->irtotal; len++) {
+					if ((scan_bit(cap, off + len) == 1) &&
+						(scan_bit(cap, off + len + 1) == 0)) {
+						break;
+					}
+				}
+			}
+		}
+		c->irlen[n] = len;
+		off += len;
+	}
+	if (off == c->irtotal) {
+		return 0;
+	}
+fail:
+	xprintf(XCORE, "jtag: cannot work out IR lengths (%d bits)\n", c->irtotal);
+	return -1;
+}
+
+int jtag_chain_scan(jtag_chain *c) {
+	u64 dr[SCAN_DR_BITS / 32];
+	u64 cap[SCAN_IR_BITS / 32];
+	u64 ir[SCAN_IR_BITS / 32];
+	unsigned n, off;
+	jtag_txn t;
+
+	memset(c, 0, sizeof(*c));
+	jtag_txn_init(&t);
+	jtag_any_to_rti(&t);
+
+	// after reset each TAP holds its IDCODE (which has bit 0 set) or
+	// BYPASS (a single 0) in DR, followed by the 1s we shift in
+	jtag_txn_move(&t, JTAG_DRSHIFT);
+	jtag_scan_shift(&t, SCAN_DR_BITS, 0xFFFFFFFF, dr, 1);
+	t.state = JTAG_DREXIT1;
+	jtag_txn_move(&t, JTAG_IDLE);
+
+	// shift 0s into every IR, catching the capture values on the
+	// way out, then 1s (BYPASS), the first of which to come out
+	// gives the total IR length
+	jtag_txn_move(&t, JTAG_IRSHIFT);
+	jtag_scan_shift(&t, SCAN_IR_BITS, 0, cap, 0);
+	jtag_scan_shift(&t, SCAN_IR_BITS, 0xFFFFFFFF, ir, 1);
+	t.state = JTAG_IREXIT1;
+	jtag_txn_move(&t, JTAG_IDLE);
+	if (jtag_txn_exec(&t)) {
+		return -1;
+	}
+
+	for (off = 0; off < (SCAN_DR_BITS - 32); ) {
+		if (scan_bit(dr, off) == 0) {
+			c->idcode[c->count] = 0;
+			off += 1;
+		} else {
+			u32 id = dr[off >> 5] >> (off & 31);
+			if (off & 31) {
+				id |= dr[(off >> 5) + 1] << (32 - (off & 31));
+			}
+			if (id == 0xFFFFFFFF) {
+				break;
+			}
+			c->idcode[c->count] = id;
+			off += 32;
+		}
+		if (++c->count == JTAG_MAX_TAPS) {
+			xprintf(XCORE, "jtag: chain too long (or TDO stuck low)\n");
+			return -1;
+		}
+	}
+	if (c->count == 0) {
+		return 0;
+	}
+
+	for (n = 0; n < SCAN_IR_BITS; n++) {
+		if (scan_bit(ir, n)) {
+			break;
+		}
+	}
+	if ((n < (2 * c->count)) || (n == SCAN_IR_BITS)) {
+		xprintf(XCORE, "jtag: cannot find IR length\n");
+		return -1;
+	}
+	c->irtotal = n;
+	return jtag_chain_irlen(c, cap);
+}
+
+void jtag_chain_select(jtag_chain *c, unsigned n, jtag_txn *t) {
+	unsigned i;
+	t->ir_pre = 0;
+	t->ir_post = 0;
+	for (i = 0; i < c->count; i++) {
+		if (i < n) {
+			t->ir_pre += c->irlen[i];
+		} else if (i > n) {
+			t->ir_post += c->irlen[i];
+		}
+	}
+	// everything else is in BYPASS, one bit each
+	t->dr_pre = n;
+	t->dr_post = c->count - n - 1;
+}
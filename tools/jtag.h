@@ -37,16 +37,20 @@
 #define JTAG_UNKNOWN	16
 
 
+// A txn starts out with room for this many words of bits and this
+// many results, and grows on the heap as needed.  jtag_txn_exec()
+// frees whatever it grew, so a txn must always be executed.
 #define JTAG_MAX_WORDS		256
-#define JTAG_MAX_BITS		((JTAG_MAX_WORDS) * 4)
 #define JTAG_MAX_RESULTS	256
 
 typedef struct jtag_txn {
-	u32 tms[JTAG_MAX_WORDS];
-	u32 tdi[JTAG_MAX_WORDS];
-	u32 tdo[JTAG_MAX_WORDS];
-	u8 bits[JTAG_MAX_RESULTS];
-	u64 *ptr[JTAG_MAX_RESULTS];
+	u32 *tms;
+	u32 *tdi;
+	u32 *tdo;
+	u8 *bits;
+	u64 **ptr;
+	unsigned maxwords;
+	unsigned maxresults;
 	unsigned txc;
 	unsigned rxc;
 	unsigned bitcount;
@@ -56,6 +60,12 @@ typedef struct jtag_txn {
 	u32 dr_pre;
 	u32 dr_post;
 	unsigned state;
+
+	u32 _tms[JTAG_MAX_WORDS];
+	u32 _tdi[JTAG_MAX_WORDS];
+	u32 _tdo[JTAG_MAX_WORDS];
+	u8 _bits[JTAG_MAX_RESULTS];
+	u64 *_ptr[JTAG_MAX_RESULTS];
 } jtag_txn;
 
 
@@ -81,6 +91,60 @@ void jtag_cjtag_cmd(jtag_txn *t, unsigned cp0, unsigned cp1);
 // clock raw TMS/TDI bit streams, does not check or update t->state
 void jtag_txn_append(jtag_txn *t, unsigned count, u64 tms, u64 tdi, u64 *tdo);
 
+// or count (1..64) bits into a bitstream at bit offset off,
+// a 32bit word at a time (at most three, when spanning two boundaries)
+static inline void jtag_pack(u32 *w, unsigned off, unsigned count, u64 bits) {
+	while (count > 0) {
+		unsigned shift = off & 31;
+		unsigned n = 32 - shift;
+		if (n > count)
+			n = count;
+		w[off >> 5] |= (((u32) bits) & (0xFFFFFFFF >> (32 - n))) << shift;
+		bits >>= n;
+		off += n;
+		count -= n;
+	}
+}
+
+// extract count (0..64) bits from a bitstream at bit offset off
+static inline u64 jtag_unpack(const u32 *w, unsigned off, unsigned count) {
+	unsigned bit = 0;
+	u64 x = 0;
+	while (bit < count) {
+		unsigned shift = off & 31;
+		unsigned n = 32 - shift;
+		if (n > (count - bit))
+			n = count - bit;
+		x |= ((u64) ((w[off >> 5] >> shift) & (0xFFFFFFFF >> (32 - n)))) << bit;
+		off += n;
+		bit += n;
+	}
+	return x;
+}
+
+// TAPs on a scan chain, numbered from the one nearest TDO.  A TAP
+// with no IDCODE register (it selects BYPASS on reset) has idcode 0.
+#define JTAG_MAX_TAPS		16
+
+typedef struct jtag_chain {
+	unsigned count;
+	unsigned irtotal;
+	u32 idcode[JTAG_MAX_TAPS];
+	u8 irlen[JTAG_MAX_TAPS];
+} jtag_chain;
+
+// reset the TAPs and find out what is on the chain and how long
+// each IR is (from a table of known parts, or the IR capture bits)
+// leaves every TAP in BYPASS and the chain in IDLE
+int jtag_chain_scan(jtag_chain *c);
+
+// set a txn's IR and DR padding to talk to TAP n alone
+void jtag_chain_select(jtag_chain *c, unsigned n, jtag_txn *t);
+
+// show the chain found on the active probe, or forget it so the
+// next attach scans again (jtag-dap.c)
+int jtag_chain_info(int forget);
+
 
 #endif
 
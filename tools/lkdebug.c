@@ -86,17 +86,23 @@ void dump_lk_threads(lkthread_t *t) {
 
 static lkthread_t *read_lk_thread(lkdebuginfo_t *di, u32 ptr, int active) {
 	lkthread_t *t = calloc(1, sizeof(lkthread_t));
+	debug_batch b;
 	u32 x;
 	int n;
 	if (t == NULL) goto fail;
 	t->threadptr = ptr;
-	if (swdp_ahb_read(ptr, &x)) goto fail;
+	// fetch the whole thread header in one exchange
+	debug_batch_init(&b);
+	debug_batch_rd_32(&b, ptr, &x);
+	debug_batch_rd_32(&b, LT_NEXT_PTR(di,ptr), &t->nextptr);
+	debug_batch_rd_32(&b, LT_STATE(di,ptr), &t->state);
+	debug_batch_rd_32(&b, LT_SAVED_SP(di,ptr), &t->saved_sp);
+	debug_batch_rd_32(&b, LT_WAITQ(di,ptr), &t->waitq);
+	for (n = 0; n < 32; n += 4) {
+		debug_batch_rd_32(&b, LT_NAME(di,ptr) + n, (void*) (t->name + n));
+	}
+	if (debug_batch_commit(&b)) goto fail;
 	if (x != LK_THREAD_MAGIC) goto fail;
-	if (swdp_ahb_read(LT_NEXT_PTR(di,ptr), &t->nextptr)) goto fail;
-	if (swdp_ahb_read(LT_STATE(di,ptr), &t->state)) goto fail;
-	if (swdp_ahb_read(LT_SAVED_SP(di,ptr), &t->saved_sp)) goto fail;
-	if (swdp_ahb_read(LT_WAITQ(di,ptr), &t->waitq)) goto fail;
-	if (swdp_ahb_read32(LT_NAME(di,ptr), (void*) t->name, 32 / 4)) goto fail;
 	t->name[31] = 0;
 	for (n = 0; n < 31; n++) {
 		if ((t->name[n] < ' ') || (t->name[n] > 127)) {
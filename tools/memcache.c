@@ -0,0 +1,233 @@
+/* memcache.c
+ *
+ * Copyright 2015 Brian Swetland <swetland@frotz.net>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fw/types.h>
+#include "debugger.h"
+
+// Host side cache of target memory that does not change behind our
+// back (flash, rom).  Only addresses inside a cacheable region (and
+// not inside a volatile one) are cached, and only the user knows
+// which memory the firmware leaves alone, so there are none until
+// set up with the memcache command.  Anything that may modify
+// target memory must invalidate the affected range.
+
+#define PAGESIZE	1024
+#define PAGEMASK	(PAGESIZE - 1)
+#define PAGEWORDS	(PAGESIZE / 4)
+#define MAXPAGES	128
+
+// pages fetched at once when reads walk sequentially through memory
+#define READAHEAD	4
+
+#define MAXREGIONS	16
+
+typedef struct {
+	u32 base;
+	u32 size;
+	int cacheable;
+} mc_region;
+
+typedef struct {
+	u32 addr;
+	u32 stamp;
+	int valid;
+	u32 data[PAGEWORDS];
+} mc_page;
+
+static mc_region regions[MAXREGIONS];
+static unsigned region_count = 0;
+
+static mc_page pages[MAXPAGES];
+static u32 stamp = 0;
+static u32 last_miss = 0xFFFFFFFF;
+
+static unsigned mc_hits = 0;
+static unsigned mc_misses = 0;
+
+// later regions take precedence over earlier ones
+static int page_cacheable(u32 addr) {
+	int n;
+	for (n = region_count - 1; n >= 0; n--) {
+		mc_region *r = regions + n;
+		if ((addr + PAGESIZE) <= r->base) continue;
+		if (addr >= (r->base + r->size)) continue;
+		if (!r->cacheable) return 0;
+		if ((addr >= r->base) && ((addr + PAGESIZE) <= (r->base + r->size))) {
+			return 1;
+		}
+		return 0;
+	}
+	return 0;
+}
+
+static mc_page *page_find(u32 addr) {
+	unsigned n;
+	for (n = 0; n < MAXPAGES; n++) {
+		if (pages[n].valid && (pages[n].addr == addr)) {
+			pages[n].stamp = ++stamp;
+			return pages + n;
+		}
+	}
+	return NULL;
+}
+
+static mc_page *page_alloc(u32 addr) {
+	mc_page *p = pages;
+	unsigned n;
+	for (n = 0; n < MAXPAGES; n++) {
+		if (!pages[n].valid) {
+			p = pages + n;
+			break;
+		}
+		if (pages[n].stamp < p->stamp) {
+			p = pages + n;
+		}
+	}
+	p->addr = addr;
+	p->stamp = ++stamp;
+	p->valid = 0;
+	return p;
+}
+
+// fetch the page at addr, and if this miss follows the previous
+// one, the next few cacheable pages too, all in one bulk read
+static mc_page *page_fill(u32 addr) {
+	u32 data[PAGEWORDS * READAHEAD];
+	unsigned n, count = 1;
+	mc_page *p = NULL;
+
+	if (addr == (last_miss + PAGESIZE)) {
+		while (count < READAHEAD) {
+			u32 next = addr + count * PAGESIZE;
+			if ((next < addr) || !page_cacheable(next) || page_find(next)) {
+				break;
+			}
+			count++;
+		}
+	}
+	last_miss = addr + (count - 1) * PAGESIZE;
+
+	if (mem_rd_32_c(addr, data, count * PAGEWORDS)) {
+		return NULL;
+	}
+	for (n = count; n > 0; n--) {
+		p = page_alloc(addr + (n - 1) * PAGESIZE);
+		memcpy(p->data, data + (n - 1) * PAGEWORDS, PAGESIZE);
+		p->valid = 1;
+	}
+	return p;
+}
+
+int memcache_read32(u32 addr, u32 *data, int count) {
+	mc_page *p;
+	u32 base;
+	int xfer;
+
+	if (addr & 3) {
+		return -1;
+	}
+	while (count > 0) {
+		base = addr & ~PAGEMASK;
+		xfer = (PAGESIZE - (addr & PAGEMASK)) / 4;
+		if (xfer > count) {
+			xfer = count;
+		}
+		if (!page_cacheable(base)) {
+			if (mem_rd_32_c(addr, data, xfer)) {
+				return -1;
+			}
+		} else {
+			if ((p = page_find(base)) != NULL) {
+				mc_hits++;
+			} else {
+				mc_misses++;
+				if ((p = page_fill(base)) == NULL) {
+					return -1;
+				}
+			}
+			memcpy(data, p->data + ((addr & PAGEMASK) / 4), xfer * 4);
+		}
+		addr += xfer * 4;
+		data += xfer;
+		count -= xfer;
+	}
+	return 0;
+}
+
+void memcache_invalidate(u32 addr, u32 len) {
+	unsigned n;
+	for (n = 0; n < MAXPAGES; n++) {
+		if (!pages[n].valid) continue;
+		if ((pages[n].addr + PAGESIZE) <= addr) continue;
+		if ((addr + len) <= pages[n].addr) continue;
+		pages[n].valid = 0;
+	}
+}
+
+void memcache_flush(void) {
+	unsigned n;
+	for (n = 0; n < MAXPAGES; n++) {
+		pages[n].valid = 0;
+	}
+	last_miss = 0xFFFFFFFF;
+}
+
+int memcache_region(u32 base, u32 size, int cacheable) {
+	unsigned n;
+	// replace an identical region rather than stacking duplicates
+	for (n = 0; n < region_count; n++) {
+		if ((regions[n].base == base) && (regions[n].size == size)) {
+			memmove(regions + n, regions + n + 1,
+				(region_count - n - 1) * sizeof(mc_region));
+			region_count--;
+			break;
+		}
+	}
+	if (region_count == MAXREGIONS) {
+		xprintf(XCORE, "memcache: too many regions\n");
+		return -1;
+	}
+	regions[region_count].base = base;
+	regions[region_count].size = size;
+	regions[region_count].cacheable = cacheable;
+	region_count++;
+	memcache_flush();
+	return 0;
+}
+
+void memcache_clear_regions(void) {
+	region_count = 0;
+	memcache_flush();
+}
+
+void memcache_dump(void) {
+	unsigned n, used = 0;
+	for (n = 0; n < region_count; n++) {
+		xprintf(XDATA, "%08x..%08x %s\n", regions[n].base,
+			regions[n].base + regions[n].size - 1,
+			regions[n].cacheable ? "cached" : "volatile");
+	}
+	for (n = 0; n < MAXPAGES; n++) {
+		if (pages[n].valid) used++;
+	}
+	xprintf(XDATA, "memcache: %u hits, %u misses, %u/%u pages\n",
+		mc_hits, mc_misses, used, MAXPAGES);
+}
@@ -0,0 +1,333 @@
+/* rswd-capture.c
+ *
+ * Copyright 2015 Brian Swetland <swetland@frotz.net>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <fw/types.h>
+#include <protocol/rswdp.h>
+
+#include "debugger.h"
+#include "rswdp.h"
+
+// Binary record of everything sent to and received from the probe.
+// The file is a header followed by a ring of records, mmap'd so that
+// recording is a memcpy and the ring survives the process dying.
+// Records are never split across the end of the ring: when one will
+// not fit, the ring wraps early and the header notes where it ended.
+
+#define CAP_MAGIC	0x43575352 // "RSWC"
+#define CAP_VERSION	1
+
+struct cap_hdr {
+	u32 magic;
+	u32 version;
+	u32 size;	// bytes of record space after the header
+	u32 head;	// where the next record goes
+	u32 tail;	// oldest record
+	u32 end;	// end of valid records before the wrap
+	u32 count;	// records in the ring
+	u32 reserved;
+	u64 t_start;	// CLOCK_MONOTONIC, microseconds
+};
+
+struct cap_rec {
+	u16 type;
+	u16 link;
+	u32 len;	// payload bytes, not including this header
+	u64 t_us;	// since t_start
+};
+
+#define REC_SIZE(len)	(sizeof(struct cap_rec) + (((len) + 7) & ~7))
+
+static pthread_mutex_t cap_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct cap_hdr *cap = NULL;
+static u8 *cap_data;
+static size_t cap_maplen;
+static u64 cap_records;
+
+static u64 cap_now_us(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((u64) ts.tv_sec) * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+int capture_open(const char *path, u32 size) {
+	int fd;
+	void *p;
+
+	capture_close();
+	if (size < 4096) {
+		size = 4096;
+	}
+	size = (size + 7) & ~7;
+	cap_maplen = sizeof(struct cap_hdr) + size;
+
+	if ((fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0) {
+		xprintf(XCORE, "capture: cannot open '%s'\n", path);
+		return -1;
+	}
+	if (ftruncate(fd, cap_maplen) < 0) {
+		xprintf(XCORE, "capture: cannot size '%s'\n", path);
+		close(fd);
+		return -1;
+	}
+	p = mmap(NULL, cap_maplen, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) {
+		xprintf(XCORE, "capture: cannot map '%s'\n", path);
+		return -1;
+	}
+
+	pthread_mutex_lock(&cap_lock);
+	cap = p;
+	cap_data = (u8*) (cap + 1);
+	cap->version = CAP_VERSION;
+	cap->size = size;
+	cap->head = 0;
+	cap->tail = 0;
+	cap->end = size;
+	cap->count = 0;
+	cap->t_start = cap_now_us();
+	cap->magic = CAP_MAGIC;
+	cap_records = 0;
+	pthread_mutex_unlock(&cap_lock);
+	return 0;
+}
+
+void capture_close(void) {
+	pthread_mutex_lock(&cap_lock);
+	if (cap) {
+		msync(cap, cap_maplen, MS_ASYNC);
+		munmap(cap, cap_maplen);
+		cap = NULL;
+	}
+	pthread_mutex_unlock(&cap_lock);
+}
+
+static void cap_drop(void) {
+	struct cap_rec *r = (void*) (cap_data + cap->tail);
+	cap->tail += REC_SIZE(r->len);
+	cap->count--;
+	if (cap->tail >= cap->end) {
+		cap->tail = 0;
+		cap->end = cap->size;
+	}
+	if (cap->count == 0) {
+		cap->tail = cap->head;
+	}
+}
+
+void capture_record(unsigned type, unsigned link, const void *data, unsigned len) {
+	struct cap_rec *r;
+	u32 n = REC_SIZE(len);
+
+	if (cap == NULL) {
+		return;
+	}
+	pthread_mutex_lock(&cap_lock);
+	if ((cap == NULL) || (n > cap->size)) {
+		goto done;
+	}
+	if ((cap->head + n) > cap->size) {
+		// drop whatever is left before the wrap, then wrap
+		while (cap->count && (cap->tail >= cap->head)) {
+			cap_drop();
+		}
+		cap->end = cap->head;
+		cap->head = 0;
+		if (cap->count == 0) {
+			cap->tail = 0;
+			cap->end = cap->size;
+		}
+	}
+	// make room by dropping the oldest records
+	while (cap->count && (cap->tail >= cap->head) &&
+		(cap->tail < (cap->head + n))) {
+		cap_drop();
+	}
+	r = (void*) (cap_data + cap->head);
+	r->type = type;
+	r->link = link;
+	r->len = len;
+	r->t_us = cap_now_us() - cap->t_start;
+	memcpy(r + 1, data, len);
+	cap->head += n;
+	cap->count++;
+	cap_records++;
+done:
+	pthread_mutex_unlock(&cap_lock);
+}
+
+void capture_status(void) {
+	pthread_mutex_lock(&cap_lock);
+	if (cap) {
+		xprintf(XDATA, "capture: %u records in ring, %llu written, %u byte ring\n",
+			cap->count, (unsigned long long) cap_records, cap->size);
+	} else {
+		xprintf(XDATA, "capture: off\n");
+	}
+	pthread_mutex_unlock(&cap_lock);
+}
+
+
+// Replay serves the recorded reply to each txn in turn.  Txns are
+// matched by position (the nth txn sent gets the reply to the nth
+// recorded txn), and a txn that differs from the recorded one is
+// counted as a divergence but still answered.
+
+struct capture_replay {
+	void *map;
+	size_t maplen;
+	struct cap_rec **rec;
+	unsigned count;
+	unsigned next;
+	unsigned link;
+	unsigned txns;
+	unsigned diverged;
+};
+
+capture_replay *replay_open(const char *path) {
+	capture_replay *rp;
+	struct cap_hdr *h;
+	struct stat st;
+	u8 *data;
+	u32 off, n;
+	int fd;
+
+	if ((fd = open(path, O_RDONLY)) < 0) {
+		xprintf(XCORE, "replay: cannot open '%s'\n", path);
+		return NULL;
+	}
+	if ((fstat(fd, &st) < 0) || (st.st_size < sizeof(struct cap_hdr))) {
+		close(fd);
+		goto bad;
+	}
+	if ((rp = calloc(1, sizeof(*rp))) == NULL) {
+		close(fd);
+		return NULL;
+	}
+	rp->maplen = st.st_size;
+	rp->map = mmap(NULL, rp->maplen, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (rp->map == MAP_FAILED) {
+		free(rp);
+		goto bad;
+	}
+	h = rp->map;
+	if ((h->magic != CAP_MAGIC) || (h->version != CAP_VERSION) ||
+		((sizeof(*h) + h->size) > rp->maplen) ||
+		(h->end > h->size) || (h->tail >= h->size)) {
+		goto fail;
+	}
+	if ((rp->rec = malloc(sizeof(rp->rec[0]) * (h->count + 1))) == NULL) {
+		goto fail;
+	}
+	data = (u8*) (h + 1);
+	off = h->tail;
+	for (n = 0; n < h->count; n++) {
+		struct cap_rec *r;
+		if ((off >= h->end) && (off != 0)) {
+			off = 0;
+		}
+		if ((off + sizeof(*r)) > h->size) {
+			goto fail;
+		}
+		r = (void*) (data + off);
+		if ((off + REC_SIZE(r->len)) > h->size) {
+			goto fail;
+		}
+		rp->rec[rp->count++] = r;
+		off += REC_SIZE(r->len);
+	}
+	// follow the link of the first txn only
+	for (n = 0; n < rp->count; n++) {
+		if (rp->rec[n]->type == CAP_TX) {
+			rp->link = rp->rec[n]->link;
+			break;
+		}
+	}
+	xprintf(XCORE, "replay: %u records from '%s'\n", rp->count, path);
+	return rp;
+
+fail:
+	free(rp->rec);
+	munmap(rp->map, rp->maplen);
+	free(rp);
+bad:
+	xprintf(XCORE, "replay: '%s' is not a capture\n", path);
+	return NULL;
+}
+
+int replay_next(capture_replay *rp, const u32 *tx, unsigned txc,
+	void *reply, unsigned max) {
+	struct cap_rec *r;
+	const u32 *rtx;
+	u32 id;
+	unsigned n;
+
+	for (;;) {
+		if (rp->next >= rp->count) {
+			return -1;
+		}
+		r = rp->rec[rp->next++];
+		if ((r->type == CAP_TX) && (r->link == rp->link)) {
+			break;
+		}
+	}
+	rtx = (const u32 *) (r + 1);
+	rp->txns++;
+	if ((r->len != (txc * 4)) ||
+		memcmp(rtx + 1, tx + 1, r->len - 4)) {
+		if (rp->diverged++ == 0) {
+			xprintf(XSWD, "replay: txn %u differs from the capture\n",
+				rp->txns);
+		}
+	}
+
+	// replies arrive in order, but may come after later txns
+	id = rtx[0];
+	for (n = rp->next; n < rp->count; n++) {
+		r = rp->rec[n];
+		if (r->link != rp->link) {
+			continue;
+		}
+		if (r->type == CAP_ERR) {
+			return -1;
+		}
+		if ((r->type == CAP_RX) && (r->len >= 4) && (r->len <= max) &&
+			(*((const u32 *) (r + 1)) == id)) {
+			memcpy(reply, r + 1, r->len);
+			// answer with the id of the txn actually sent
+			*((u32 *) reply) = tx[0];
+			return r->len;
+		}
+	}
+	return -1;
+}
+
+void replay_status(capture_replay *rp) {
+	xprintf(XSWD, "replay: %u txns served, %u differed, %u of %u records used\n",
+		rp->txns, rp->diverged, rp->next, rp->count);
+}
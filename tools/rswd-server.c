@@ -0,0 +1,131 @@
+/* rswd-server.c
+ *
+ * Copyright 2015 Brian Swetland <swetland@frotz.net>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <getopt.h>
+#include <signal.h>
+#include <sys/socket.h>
+
+#include <fw/types.h>
+
+#include "usb.h"
+#include "socket.h"
+
+// Bridges the bulk endpoints of a local probe to a socket so that a
+// debugger elsewhere can use it with "debugger -R host:port".  Every
+// usb packet becomes one frame and vice versa, in both directions at
+// once, so txns stay pipelined and SWO data flows as it arrives.
+// The probe is opened when a debugger connects and closed when it
+// goes away, and only one debugger is served at a time.
+
+#define MAXBYTES	8192
+#define RXBUFFERS	4
+
+static const char *serial = NULL;
+
+static usb_handle *probe_open(void) {
+	usb_handle *usb;
+	if ((usb = usb_open_serial(0x1209, 0x5038, 0, serial))) return usb;
+	if ((usb = usb_open_serial(0x18d1, 0xdb03, 0, serial))) return usb;
+	if ((usb = usb_open_serial(0x18d1, 0xdb04, 0, serial))) return usb;
+	return NULL;
+}
+
+// called from the usb event thread for every packet from the probe
+static void probe_rx(void *cookie, void *data, int len) {
+	int fd = *((int*) cookie);
+	if ((len < 0) || socket_send_frame(fd, data, len)) {
+		// unblock the reader in serve()
+		shutdown(fd, SHUT_RDWR);
+	}
+}
+
+static void serve(int fd) {
+	char sn[64];
+	usb_handle *usb;
+	u8 *buf;
+	int len;
+
+	if ((buf = malloc(MAXBYTES)) == NULL) {
+		return;
+	}
+	if ((usb = probe_open()) == NULL) {
+		fprintf(stderr, "rswd-server: no debugger device\n");
+		free(buf);
+		return;
+	}
+	sn[0] = 0;
+	usb_get_serial(usb, sn, sizeof(sn));
+	fprintf(stderr, "rswd-server: client connected, probe %s\n",
+		sn[0] ? sn : "<no serial>");
+
+	if (usb_start_rx(usb, RXBUFFERS, MAXBYTES, probe_rx, &fd) == 0) {
+		while ((len = socket_recv_frame(fd, buf, MAXBYTES)) >= 0) {
+			if (usb_queue_write(usb, buf, len) != len) {
+				fprintf(stderr, "rswd-server: usb write failed\n");
+				break;
+			}
+		}
+	}
+	usb_close(usb);
+	free(buf);
+	fprintf(stderr, "rswd-server: client disconnected\n");
+}
+
+static void usage(void) {
+	fprintf(stderr, "usage: rswd-server [-s serial] [-l [host:]port|unix:path]\n"
+		"  default is to listen on localhost:5556\n");
+	exit(1);
+}
+
+int main(int argc, char **argv) {
+	const char *addr = "localhost:5556";
+	int fd, s, c;
+
+	while ((c = getopt(argc, argv, "s:l:h")) != -1) {
+		switch (c) {
+		case 's':
+			serial = optarg;
+			break;
+		case 'l':
+			addr = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+
+	if ((fd = socket_listen(addr)) < 0) {
+		fprintf(stderr, "rswd-server: cannot listen on '%s'\n", addr);
+		return -1;
+	}
+	fprintf(stderr, "rswd-server: listening on %s\n", addr);
+	for (;;) {
+		if ((s = accept(fd, NULL, NULL)) < 0) {
+			continue;
+		}
+		socket_nodelay(s);
+		serve(s);
+		close(s);
+	}
+	return 0;
+}
@@ -0,0 +1,519 @@
+/* rswd-sim.c
+ *
+ * Copyright 2015 Brian Swetland <swetland@frotz.net>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <fw/types.h>
+#include <protocol/rswdp.h>
+
+#include "debugger.h"
+#include "rswdp.h"
+#include "arm-v7m.h"
+
+// A probe and Cortex-M3 target simulated well enough for the host
+// side to attach, read and write memory and core registers, halt,
+// step, and reset, so it can be tested and benchmarked without any
+// hardware.  The core never executes anything: once resumed it just
+// stays running until halted again.
+//
+// The SW-DP has CTRL/STAT with power-up acks and STICKYERR, SELECT,
+// RDBUFF, and posted AP reads.  The AHB-AP has CSW (8/16/32 bit,
+// single and packed increment), TAR with auto-increment that wraps
+// at a configurable boundary, DRW and BD0-3.  Memory is sparse and
+// reads as zero until written.  Accesses at or above 0xE0100000 (other
+// than the ROM table) fault, and FAULT the next access, like hardware.
+
+#define SIM_IDCODE	IDCODE_M3
+#define SIM_CPUID	0x412FC230
+#define SIM_AP_IDR	0x24770011
+#define SIM_ROMTABLE	0xE00FF000
+
+#define CPUID		0xE000ED00
+
+#define PAGESIZE	4096
+
+static struct {
+	// SW-DP
+	u32 ctrl;
+	u32 select;
+	u32 posted;
+	u32 last;
+	int sticky;
+
+	// AHB-AP
+	u32 csw;
+	u32 tar;
+
+	// core debug
+	u32 regs[32];
+	u32 dhcsr;
+	u32 dcrdr;
+	u32 demcr;
+	int halted;
+} sim = {
+	.csw = 0x23000052,
+	.dhcsr = DHCSR_C_DEBUGEN | DHCSR_C_HALT,
+	.halted = 1,
+};
+
+static unsigned sim_latency = 0;
+static unsigned sim_err = 0;
+static unsigned sim_err_every = 0;
+static u32 sim_wrap = 0x1000;
+
+static unsigned sim_txns = 0;
+static unsigned sim_xfers = 0;
+static unsigned sim_injected = 0;
+
+// two level table of 4K pages, allocated on first write
+static u8 **sim_mem[1024];
+
+static u8 *sim_page(u32 addr, int alloc) {
+	u8 ***l1 = sim_mem + (addr >> 22);
+	u8 **pg;
+	if (*l1 == NULL) {
+		if (!alloc || ((*l1 = calloc(1024, sizeof(u8*))) == NULL)) {
+			return NULL;
+		}
+	}
+	pg = *l1 + ((addr >> 12) & 1023);
+	if (*pg == NULL) {
+		if (!alloc || ((*pg = calloc(1, PAGESIZE)) == NULL)) {
+			return NULL;
+		}
+	}
+	return *pg + (addr & (PAGESIZE - 1));
+}
+
+static u32 sim_rom_read(u32 addr) {
+	switch (addr & 0xFFF) {
+	case 0x000: return 0xFFF0F003; // SCS
+	case 0x004: return 0xFFF02003; // DWT
+	case 0x008: return 0xFFF03003; // FPB
+	case 0xFF0: return 0x0D;
+	case 0xFF4: return 0x10;
+	case 0xFF8: return 0x05;
+	case 0xFFC: return 0xB1;
+	default: return 0;
+	}
+}
+
+static void sim_core_reset(void) {
+	u8 *p;
+	memset(sim.regs, 0, sizeof(sim.regs));
+	if ((p = sim_page(0, 0)) != NULL) {
+		memcpy(&sim.regs[13], p, 4);
+		memcpy(&sim.regs[15], p + 4, 4);
+		sim.regs[15] &= ~1;
+	}
+	sim.regs[16] = 0x01000000;
+	sim.dhcsr |= DHCSR_S_RESET_ST;
+	sim.halted = !!(sim.demcr & DEMCR_VC_CORERESET);
+}
+
+// aligned word containing addr, -1 on a bus fault
+static int sim_mem_read(u32 addr, u32 *val) {
+	u8 *p;
+	addr &= ~3;
+	*val = 0;
+	if ((addr & ~0xFFF) == SIM_ROMTABLE) {
+		*val = sim_rom_read(addr);
+		return 0;
+	}
+	if (addr >= 0xE0100000) {
+		return -1;
+	}
+	switch (addr) {
+	case DHCSR:
+		*val = (sim.dhcsr & 0x0000FFFF) | DHCSR_S_REGRDY |
+			(sim.halted ? DHCSR_S_HALT : 0) |
+			(sim.dhcsr & DHCSR_S_RESET_ST);
+		// reset status is sticky until read
+		sim.dhcsr &= ~DHCSR_S_RESET_ST;
+		return 0;
+	case DCRDR:
+		*val = sim.dcrdr;
+		return 0;
+	case DEMCR:
+		*val = sim.demcr;
+		return 0;
+	case CPUID:
+		*val = SIM_CPUID;
+		return 0;
+	}
+	if ((p = sim_page(addr, 0)) != NULL) {
+		memcpy(val, p, 4);
+	}
+	return 0;
+}
+
+// write the byte lanes of val selected by size (0/1/2) and addr
+static int sim_mem_write(u32 addr, u32 val, unsigned size) {
+	u8 *p;
+	if (addr >= 0xE0100000) {
+		return -1;
+	}
+	switch (addr & ~3) {
+	case DHCSR:
+		if ((val & 0xFFFF0000) != DHCSR_DBGKEY) {
+			return 0;
+		}
+		sim.dhcsr = (sim.dhcsr & ~0xFFFF) | (val & 0x2F);
+		if (!(val & DHCSR_C_DEBUGEN)) {
+			sim.halted = 0;
+		} else if (val & DHCSR_C_HALT) {
+			sim.halted = 1;
+		} else if (val & DHCSR_C_STEP) {
+			// one instruction, which we pretend is 16 bits
+			sim.regs[15] += 2;
+			sim.halted = 1;
+		} else {
+			sim.halted = 0;
+		}
+		return 0;
+	case DCRSR:
+		if (sim.halted) {
+			if (val & DCRSR_REG_WR) {
+				sim.regs[val & 31] = sim.dcrdr;
+			} else {
+				sim.dcrdr = sim.regs[val & 31];
+			}
+		}
+		return 0;
+	case DCRDR:
+		sim.dcrdr = val;
+		return 0;
+	case DEMCR:
+		sim.demcr = val;
+		return 0;
+	case AIRCR:
+		if (((val >> 16) == 0x05FA) && (val & 5)) {
+			sim_core_reset();
+		}
+		return 0;
+	}
+	if ((p = sim_page(addr & ~3, 1)) == NULL) {
+		return -1;
+	}
+	if (size == 0) {
+		p[addr & 3] = val >> (8 * (addr & 3));
+	} else if (size == 1) {
+		p[addr & 2] = val >> (8 * (addr & 2));
+		p[(addr & 2) + 1] = val >> (8 * (addr & 2) + 8);
+	} else {
+		memcpy(p, &val, 4);
+	}
+	return 0;
+}
+
+static void sim_tar_inc(u32 step) {
+	sim.tar = (sim.tar & ~(sim_wrap - 1)) | ((sim.tar + step) & (sim_wrap - 1));
+}
+
+// one DRW access: a single transfer, or 4/size of them when packed
+static u32 sim_drw(int rd, u32 val) {
+	unsigned size = sim.csw & 7;
+	unsigned inc = (sim.csw >> 4) & 3;
+	unsigned step, n;
+	u32 word, out = 0;
+
+	if (size > 2) {
+		sim.sticky = 1;
+		return 0;
+	}
+	step = 1 << size;
+	n = ((inc == 2) && (size < 2)) ? (4 - (sim.tar & 3)) / step : 1;
+	while (n-- > 0) {
+		if (rd) {
+			if (sim_mem_read(sim.tar, &word)) {
+				sim.sticky = 1;
+				return 0;
+			}
+			if (size == 2) {
+				out = word;
+			} else {
+				u32 mask = ((size == 0) ? 0xFF : 0xFFFF) << (8 * (sim.tar & 3));
+				out |= word & mask;
+			}
+		} else if (sim_mem_write(sim.tar, val, size)) {
+			sim.sticky = 1;
+			return 0;
+		}
+		if (inc) {
+			sim_tar_inc((inc == 2) ? step : ((size == 2) ? 4 : step));
+		}
+	}
+	return out;
+}
+
+static u32 sim_ap_access(int rd, unsigned addr, u32 val) {
+	u32 word;
+	if (sim.select >> 24) {
+		// only AP 0 exists
+		return 0;
+	}
+	addr = (sim.select & 0xF0) | (addr & 0x0C);
+	switch (addr) {
+	case AHB_CSW:
+		if (rd) {
+			return sim.csw | (1 << 6);
+		}
+		sim.csw = val;
+		return 0;
+	case AHB_TAR:
+		if (rd) {
+			return sim.tar;
+		}
+		sim.tar = val;
+		return 0;
+	case AHB_DRW:
+		return sim_drw(rd, val);
+	case 0x10:
+	case 0x14:
+	case 0x18:
+	case 0x1C:
+		// BD0-3
+		addr = (sim.tar & ~0xF) | (addr & 0xC);
+		if (rd) {
+			if (sim_mem_read(addr, &word)) {
+				sim.sticky = 1;
+			}
+			return word;
+		}
+		if (sim_mem_write(addr, val, 2)) {
+			sim.sticky = 1;
+		}
+		return 0;
+	case AHB_ROM_ADDR:
+		return SIM_ROMTABLE | 3;
+	case AHB_IDR:
+		return SIM_AP_IDR;
+	default:
+		return 0;
+	}
+}
+
+static void sim_dp_access(int rd, unsigned addr, u32 *val) {
+	switch (addr & 0xC) {
+	case 0x0:
+		if (rd) {
+			*val = SIM_IDCODE;
+		} else if (*val & 0x1E) {
+			sim.sticky = 0;
+		}
+		break;
+	case 0x4:
+		if (rd) {
+			// power-up acks follow the requests
+			*val = sim.ctrl | ((sim.ctrl & (1 << 28)) << 1) |
+				((sim.ctrl & (1 << 30)) << 1) |
+				(sim.sticky ? (1 << 5) : 0);
+		} else {
+			sim.ctrl = *val & 0x50000F00;
+		}
+		break;
+	case 0x8:
+		if (rd) {
+			*val = sim.last;
+		} else {
+			sim.select = *val;
+		}
+		break;
+	case 0xC:
+		// RDBUFF, or TARGETSEL (accepted, there is only one DP)
+		if (rd) {
+			*val = sim.posted;
+		}
+		break;
+	}
+}
+
+// one SWD transfer, returning the error the probe would report
+static int sim_swd_io(unsigned op, u32 *val) {
+	int rd = !(op & OP_WR);
+
+	sim_xfers++;
+	if (sim_err_every && ((sim_xfers % sim_err_every) == 0)) {
+		sim_injected++;
+		return sim_err;
+	}
+	if (op & OP_AP) {
+		if (sim.sticky) {
+			return ERR_IO;
+		}
+		if (rd) {
+			*val = sim.posted;
+			sim.posted = sim_ap_access(1, op, 0);
+		} else {
+			sim_ap_access(0, op, *val);
+		}
+	} else {
+		if (sim.sticky && rd && ((op & 0xC) == 0xC)) {
+			return ERR_IO;
+		}
+		sim_dp_access(rd, op, val);
+	}
+	if (rd) {
+		sim.last = *val;
+	}
+	return ERR_NONE;
+}
+
+int sim_txn(void *cookie, const u32 *tx, unsigned txc, void *reply, unsigned max) {
+	const u32 *end = tx + txc;
+	u32 *rx = reply;
+	unsigned rxc = 0, cmds = 0;
+	unsigned limit = (max / 4) - 1;
+	int err = ERR_NONE;
+
+	if (sim_latency) {
+		usleep(sim_latency);
+	}
+	sim_txns++;
+	rx[rxc++] = *tx++;
+
+	while ((tx < end) && (err == ERR_NONE)) {
+		u32 msg = *tx++;
+		unsigned op = RSWD_MSG_OP(msg);
+		unsigned n = RSWD_MSG_ARG(msg);
+		u32 val, *hdr;
+
+		cmds++;
+		switch (RSWD_MSG_CMD(msg)) {
+		case CMD_NULL:
+			break;
+		case CMD_SWD_WRITE:
+			if ((end - tx) < n) {
+				err = ERR_INTERNAL;
+				break;
+			}
+			while ((n-- > 0) && (err == ERR_NONE)) {
+				val = *tx++;
+				err = sim_swd_io(op, &val);
+			}
+			break;
+		case CMD_SWD_READ:
+			if ((rxc + n + 1) > limit) {
+				err = ERR_INTERNAL;
+				break;
+			}
+			hdr = rx + rxc++;
+			while ((n-- > 0) && (err == ERR_NONE)) {
+				if ((err = sim_swd_io(op, &val)) == ERR_NONE) {
+					rx[rxc++] = val;
+				}
+			}
+			*hdr = RSWD_MSG(CMD_SWD_DATA, 0, (rx + rxc) - (hdr + 1));
+			break;
+		case CMD_SWD_DISCARD:
+			while ((n-- > 0) && (err == ERR_NONE)) {
+				err = sim_swd_io(op, &val);
+			}
+			break;
+		case CMD_ATTACH:
+			break;
+		case CMD_RESET:
+			if (n) {
+				sim_core_reset();
+			}
+			break;
+		case CMD_DOWNLOAD:
+			if ((end - tx) < (n + 1)) {
+				err = ERR_INTERNAL;
+				break;
+			}
+			val = *tx++;
+			while (n-- > 0) {
+				sim_mem_write(val, *tx++, 2);
+				val += 4;
+			}
+			break;
+		case CMD_EXECUTE:
+			if (tx < end) {
+				sim.regs[15] = *tx++ & ~1;
+				sim.halted = 0;
+			}
+			break;
+		case CMD_TRACE:
+		case CMD_BOOTLOADER:
+			break;
+		case CMD_SET_CLOCK:
+		case CMD_SWO_CLOCK:
+			if (rxc < limit) {
+				rx[rxc++] = RSWD_MSG(CMD_CLOCK_KHZ,
+					RSWD_MSG_CMD(msg) == CMD_SWO_CLOCK, n);
+			}
+			break;
+		case CMD_VERSION:
+			if ((rxc + 4) > limit) {
+				err = ERR_INTERNAL;
+				break;
+			}
+			rx[rxc++] = RSWD_MSG(CMD_VERSION, 0, RSWD_VERSION);
+			rx[rxc++] = RSWD_MSG(CMD_BOARD_STR, 0, 1);
+			memcpy(rx + rxc++, "sim", 4);
+			rx[rxc++] = RSWD_MSG(CMD_RX_MAXDATA, 0, 8192);
+			break;
+		case CMD_JTAG_IO:
+			// TDO is TDI, as if through a single BYPASS-less wire
+			n = (n + 31) / 32;
+			if (((end - tx) < (n * 2)) || ((rxc + n + 1) > limit)) {
+				err = ERR_INTERNAL;
+				break;
+			}
+			rx[rxc++] = RSWD_MSG(CMD_JTAG_DATA, 0, RSWD_MSG_ARG(msg));
+			while (n-- > 0) {
+				rx[rxc++] = tx[1];
+				tx += 2;
+			}
+			break;
+		default:
+			err = ERR_INTERNAL;
+			break;
+		}
+	}
+	rx[rxc++] = RSWD_MSG(CMD_STATUS, err, cmds);
+	return rxc * 4;
+}
+
+void sim_set_latency(unsigned us) {
+	sim_latency = us;
+}
+
+void sim_set_errors(unsigned err, unsigned every) {
+	sim_err = err;
+	sim_err_every = err ? every : 0;
+}
+
+void sim_set_wrap(u32 size) {
+	sim_wrap = size;
+}
+
+void sim_status(void) {
+	xprintf(XDATA, "sim: latency %u us, TAR wrap %x\n", sim_latency, sim_wrap);
+	if (sim_err_every) {
+		xprintf(XDATA, "sim: %s error every %u transfers\n",
+			swd_err_str(sim_err), sim_err_every);
+	}
+	xprintf(XDATA, "sim: %u txns, %u transfers, %u errors injected\n",
+		sim_txns, sim_xfers, sim_injected);
+	xprintf(XDATA, "sim: core %s, pc %08x\n",
+		sim.halted ? "halted" : "running", sim.regs[15]);
+}
@@ -21,8 +21,10 @@
 #include <string.h>
 
 #include <pthread.h>
+#include <time.h>
 
 #include "usb.h"
+#include "socket.h"
 
 #include <fw/types.h>
 #include <protocol/rswdp.h>
@@ -33,38 +35,186 @@
 
 int swd_verbose = 0;
 
-static pthread_mutex_t swd_lock = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t swd_event = PTHREAD_COND_INITIALIZER;
-static pthread_t swd_thread;
-
-// these are all protected by swd_lock
-static u16 sequence = 1;
-static int swd_online = 0;
-static usb_handle *usb = NULL;
-
-static unsigned swd_txn_id = 0;
-static void *swd_txn_data = NULL;
-static int swd_txn_status = 0;
-
 #define TXN_STATUS_WAIT		-2
 #define TXN_STATUS_FAIL		-1
+#define TXN_STATUS_DONE		0
 
-// swd_thread is responsible for setting swd_online to 1 once
-// the USB connection is active.
-//
-// In the event of a usb connection error, swd_thread sets
-// swd_online to -1, and the next swd io attempt must acknowledge
-// this by zeroing the usb handle and setting swd_online to 0
-// at which point the swd_thread may attempt to reconnect.
+// Up to MAXINFLIGHT transactions may be outstanding at once.
+// Replies are matched to them by sequence number as they arrive.
+#define MAXINFLIGHT		4
 
 #define MAXWORDS (8192/4)
-static unsigned swd_maxwords = 512;
-static unsigned swd_version = 0x0001;
+#define SERIALMAX 64
+
+// where rswd-server listens by default
+#define RSWD_SERVER_PORT "5556"
+
+// 10 bits of TAR auto-increment is the minimum required by spec (and
+// some targets like rp2040 are limited to this), but many do 12 or
+// more.  The real boundary is probed on attach unless overridden.
+#define WRAPSIZE_MIN 0x400
+#define WRAPSIZE_MAX 0x1000
+
+/* DP SELECT and AP CSW/TAR as they will be once every queued txn has
+ * run, so txns can skip writes that would not change anything.
+ * Dropped on any error, on attach, and when the target changes.
+ */
+struct ap_state {
+	u32 select;
+	u32 csw;
+	u32 tar;
+};
+
+/* Link statistics.  The probe retries SWD WAIT acks itself and
+ * reports ERR_TIMEOUT when it gives up, and a FAULT ack as ERR_IO.
+ * Latency is from handing a txn to usb to its reply arriving, in
+ * log2 microsecond buckets.
+ */
+#define LAT_BUCKETS 24
+
+struct swd_stats {
+	u64 txns;
+	u64 words_tx;
+	u64 words_rx;
+	u32 errors[ERR_PARITY + 2];
+	u32 attaches;
+	u32 recoveries;
+	u32 lat[LAT_BUCKETS];
+	u64 lat_total;
+	u32 lat_max;
+};
+
+/* One debug port on the wire.  With SWD multi-drop several may share
+ * a probe, each selected by its TARGETSEL value, and each keeps its
+ * own AP shadow so switching between them costs only a line reset,
+ * TARGETSEL, and DPIDR read, inserted in front of the next txn.
+ */
+struct swd_dp {
+	u32 targetsel;
+	unsigned on;
+	int attached;
+	struct ap_state ap;
+	u32 wrapsize;
+	int packed;
+	u32 idcode;
+};
+
+#define MAXDPS 8
+
+/* Everything about one probe.  Each link has its own reader thread,
+ * which opens the usb device (the one with the requested serial
+ * number, or the first free one) and sets online to 1 once the
+ * probe has answered the version query.
+ *
+ * In the event of a usb connection error, swd_rx sets online
+ * to -1, and the next swd io attempt must acknowledge this by
+ * zeroing the usb handle and setting online to 0 at which point
+ * the reader thread closes usb and may attempt to reconnect.
+ *
+ * Commands always act on the active link, swd.  Code running on
+ * the reader and usb threads is passed its link explicitly.
+ */
+struct swd_link {
+	pthread_mutex_t lock;
+	pthread_cond_t event;
+	pthread_t thread;
+	char want[SERIALMAX];
+	unsigned index;
+
+	// txns answered in-process (capture replay, simulator) not by usb
+	swd_local_fn local;
+	void *local_cookie;
+	capture_replay *replay;
+	u32 (*queue)[MAXWORDS];
+	unsigned queue_len[MAXINFLIGHT + 1];
+	unsigned queue_head;
+	unsigned queue_count;
+
+	// txns carried over a socket to an rswd-server (want is its address)
+	int remote;
+
+	// these are all protected by lock
+	u16 sequence;
+	int online;
+	usb_handle *usb;
+	int sock;
+	struct txn *inflight[MAXINFLIGHT];
+	unsigned inflight_count;
+	unsigned query_id;
+	// kept so a capture started later can begin with it
+	u32 query_reply[32];
+	unsigned query_reply_len;
+	unsigned maxwords;
+	unsigned version;
+	char serial[SERIALMAX];
+	int error;
+	struct swd_stats stats;
+
+	// SWCLK as requested by us and as last reported by the probe
+	unsigned clock_khz;
+	unsigned clock_actual;
+
+	// the rest is only used by the command thread
+	struct swd_dp dps[MAXDPS];
+	unsigned dp_count;
+	// the DP commands act on, and the one last selected on the wire
+	struct swd_dp *dp;
+	struct swd_dp *wire;
+	u32 wire_idcode;
+};
+
+#define MAXLINKS 8
+
+static struct swd_link *swd_links[MAXLINKS];
+static unsigned swd_links_count = 0;
+static struct swd_link *swd = NULL;
+
+static void dp_state_init(struct swd_dp *dp, u32 targetsel, unsigned on) {
+	memset(dp, 0, sizeof(*dp));
+	dp->targetsel = targetsel;
+	dp->on = on;
+	dp->wrapsize = WRAPSIZE_MIN;
+	dp->ap.select = 0xffffffff;
+	dp->ap.csw = 0xffffffff;
+	dp->ap.tar = 0xffffffff;
+}
+
+// after an error neither the AP state nor which DP is selected is known
+static void ap_state_invalidate(void) {
+	swd->dp->ap.select = 0xffffffff;
+	swd->dp->ap.csw = 0xffffffff;
+	swd->dp->ap.tar = 0xffffffff;
+	swd->wire = NULL;
+}
 
-static int swd_error = 0;
+static u64 swd_now_us(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((u64) ts.tv_sec) * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+// called with the link lock held
+static void stats_reply(struct swd_link *swd, u64 t_submit,
+	int result, unsigned words) {
+	u32 us = swd_now_us() - t_submit;
+	unsigned n = 0;
+	while ((n < (LAT_BUCKETS - 1)) && (us >> (n + 1)))
+		n++;
+	swd->stats.lat[n]++;
+	swd->stats.lat_total += us;
+	if (us > swd->stats.lat_max)
+		swd->stats.lat_max = us;
+	swd->stats.words_rx += words;
+	if (result < 0) {
+		n = -result;
+		if (n > ERR_PARITY)
+			n = ERR_PARITY + 1;
+		swd->stats.errors[n]++;
+	}
+}
 
 static int _swdp_error(void) {
-	return swd_error;
+	return swd->error;
 }
 
 struct txn {
@@ -77,9 +227,11 @@ struct txn {
 	unsigned txc;
 	unsigned rxc;
 
-	/* cached state */
-	u32 cache_apaddr;
-	u32 cache_ahbtar;
+	/* sequence id and completion status while in flight */
+	u32 id;
+	int status;
+	int result;
+	u64 t_submit;
 
 	unsigned magic;
 };
@@ -87,7 +239,9 @@ struct txn {
 void process_swo_data(void *data, unsigned count);
 void transmit_swo_data(void *data, unsigned count);
 
-static void process_async(u32 *data, unsigned count) {
+// called from the rx thread of the link the packet arrived on, which
+// need not be the active one
+static void process_async(struct swd_link *swd, u32 *data, unsigned count) {
 	unsigned msg, n;
 	u32 tmp;
 	while (count-- > 0) {
@@ -108,7 +262,7 @@ static void process_async(u32 *data, unsigned count) {
 			break;
 		case CMD_SWO_DATA:
 			n = RSWD_MSG_ARG(msg);
-			if (swd_version < RSWD_VERSION_1_1) {
+			if (swd->version < RSWD_VERSION_1_1) {
 				// arg is wordcount
 				tmp = n;
 				n *= 4;
@@ -128,7 +282,7 @@ static void process_async(u32 *data, unsigned count) {
 	}
 }
 
-static void process_query(u32 *data, unsigned count) {
+static void process_query(struct swd_link *swd, u32 *data, unsigned count) {
 	unsigned n;
 	const char *board = "unknown";
 	const char *build = "unknown";
@@ -174,8 +328,8 @@ done:
 	if (version < 0x0103) {
 		xprintf(XSWD, "usb: WARNING, FIRMWARE OUT OF DATE\n");
 	}
-	swd_version = version;
-	swd_maxwords = maxdata / 4;
+	swd->version = version;
+	swd->maxwords = maxdata / 4;
 }
 
 const char *swd_err_str(unsigned op) {
@@ -189,7 +343,59 @@ const char *swd_err_str(unsigned op) {
 	}
 }
 
-static int process_reply(struct txn *t, u32 *data, int count) {
+void swdp_stats_reset(void) {
+	pthread_mutex_lock(&swd->lock);
+	memset(&swd->stats, 0, sizeof(swd->stats));
+	pthread_mutex_unlock(&swd->lock);
+}
+
+void swdp_stats_dump(void) {
+	unsigned n, max;
+	struct swd_stats st;
+
+	pthread_mutex_lock(&swd->lock);
+	st = swd->stats;
+	pthread_mutex_unlock(&swd->lock);
+
+	if (swd->replay) {
+		replay_status(swd->replay);
+	}
+	xprintf(XDATA, "txns:    %llu (%llu words out, %llu words in)\n",
+		(unsigned long long) st.txns,
+		(unsigned long long) st.words_tx,
+		(unsigned long long) st.words_rx);
+	xprintf(XDATA, "errors: ");
+	for (n = ERR_INTERNAL; n <= (ERR_PARITY + 1); n++) {
+		xprintf(XDATA, " %s %u", swd_err_str(n), st.errors[n]);
+	}
+	xprintf(XDATA, "\n");
+	xprintf(XDATA, "wait:    %u  fault: %u\n",
+		st.errors[ERR_TIMEOUT], st.errors[ERR_IO]);
+	xprintf(XDATA, "attach:  %u  recover: %u\n",
+		st.attaches, st.recoveries);
+	if (st.txns) {
+		xprintf(XDATA, "latency: avg %llu us, max %u us\n",
+			(unsigned long long) (st.lat_total / st.txns),
+			st.lat_max);
+	}
+	for (max = 0, n = 0; n < LAT_BUCKETS; n++) {
+		if (st.lat[n] > max)
+			max = st.lat[n];
+	}
+	for (n = 0; n < LAT_BUCKETS; n++) {
+		char bar[41];
+		unsigned len;
+		if (st.lat[n] == 0)
+			continue;
+		len = (st.lat[n] * 40ULL + max - 1) / max;
+		memset(bar, '#', len);
+		bar[len] = 0;
+		xprintf(XDATA, "%8u us %8u %s\n", 1 << n, st.lat[n], bar);
+	}
+}
+
+static int process_reply(struct swd_link *swd, struct txn *t,
+	u32 *data, int count) {
 	unsigned msg, op, n, rxp, rxc;
 
 	rxc = t->rxc;
@@ -234,13 +440,15 @@ static int process_reply(struct txn *t, u32 *data, int count) {
 				if (swd_verbose) {
 					xprintf(XSWD, "SWD ERROR: %s\n", swd_err_str(op));
 				}
-				swd_error = -op;
+				swd->error = -op;
 				return -op;
 			} else {
 				return 0;
 			}
 		case CMD_CLOCK_KHZ:
 			xprintf(XSWD,"mdebug: %s clock: %d KHz\n", op ? "SWO" : "SWD", n);
+			if (op == 0)
+				swd->clock_actual = n;
 			continue;
 		default:
 			xprintf(XSWD,"unknown command 0x%02x\n", RSWD_MSG_CMD(msg));
@@ -305,11 +513,53 @@ static void q_dump(u32* tx, unsigned count) {
 }
 #endif
 
-static int q_exec(struct txn *t) {
-	unsigned data[MAXWORDS];
-	unsigned seq;
+// remove a txn from the in-flight list (the link lock must be held)
+static void q_retire(struct swd_link *swd, struct txn *t) {
+	unsigned n;
+	for (n = 0; n < swd->inflight_count; n++) {
+		if (swd->inflight[n] == t) {
+			swd->inflight_count--;
+			memmove(swd->inflight + n, swd->inflight + n + 1,
+				(swd->inflight_count - n) * sizeof(swd->inflight[0]));
+			return;
+		}
+	}
+}
+
+// queue a txn for swd_local to answer
+static int local_write(struct swd_link *swd, u32 *data, unsigned count) {
+	unsigned n;
+	if ((swd->queue_count == (MAXINFLIGHT + 1)) || (count > MAXWORDS)) {
+		return -1;
+	}
+	n = (swd->queue_head + swd->queue_count) % (MAXINFLIGHT + 1);
+	memcpy(swd->queue[n], data, count * sizeof(u32));
+	swd->queue_len[n] = count;
+	swd->queue_count++;
+	pthread_cond_broadcast(&swd->event);
+	return 0;
+}
+
+// (the link lock must be held)
+static int link_write(struct swd_link *swd, u32 *data, unsigned count) {
+	capture_record(CAP_TX, swd->index, data, count * sizeof(u32));
+	if (swd->local) {
+		return local_write(swd, data, count);
+	}
+	if (swd->remote) {
+		return socket_send_frame(swd->sock, data, count * sizeof(u32));
+	}
+	if (usb_queue_write(swd->usb, data, count * sizeof(u32)) !=
+		(count * sizeof(u32))) {
+		return -1;
+	}
+	return 0;
+}
+
+// send a txn to the probe without waiting for the reply
+// replies are processed by swd_reader as they arrive
+static int q_submit(struct txn *t) {
 	int r;
-	u32 id;
 
 	if (t->magic != 0x12345678) {
 		fprintf(stderr,"FATAL: bogus txn magic\n");
@@ -320,121 +570,280 @@ static int q_exec(struct txn *t) {
 	/* If we are a multiple of 64, and not exactly 4K,
 	 * add padding to ensure the target can detect the end of txn
 	 */
-	if (((t->txc % 16) == 0) && (t->txc != swd_maxwords))
+	if (((t->txc % 16) == 0) && (t->txc != swd->maxwords))
 		t->tx[t->txc++] = RSWD_MSG(CMD_NULL, 0, 0);
 
 #if TRACE_RSWD_XMIT
 	q_dump(t->tx + 1, t->txc - 1);
 #endif
 
-	pthread_mutex_lock(&swd_lock);
- 	seq = sequence++;
-	id = RSWD_TXN_START(seq);
-	t->tx[0] = id;
+	pthread_mutex_lock(&swd->lock);
+	// wait for room in the window
+	while ((swd->online == 1) && (swd->inflight_count == MAXINFLIGHT)) {
+		pthread_cond_wait(&swd->event, &swd->lock);
+	}
+
+	t->id = RSWD_TXN_START(swd->sequence++);
+	t->tx[0] = t->id;
 
-	if (swd_online != 1) {
-		if (swd_online == -1) {
-			// ack disconnect
-			usb_close(usb);
-			usb = NULL;
-			swd_online = 0;
-			pthread_cond_broadcast(&swd_event);
+	if (swd->online != 1) {
+		if (swd->online == -1) {
+			// ack disconnect, swd_reader will close usb
+			swd->usb = NULL;
+			swd->sock = -1;
+			swd->online = 0;
+			pthread_cond_broadcast(&swd->event);
 		}
+		t->status = TXN_STATUS_FAIL;
 		r = -1;
 	} else {
-		r = usb_write(usb, t->tx, t->txc * sizeof(u32));
-		if (r == (t->txc * sizeof(u32))) {
-			swd_txn_id = id;
-			swd_txn_data = data;
-			swd_txn_status = TXN_STATUS_WAIT;
-			do {
-				pthread_cond_wait(&swd_event, &swd_lock);
-			} while (swd_txn_status == TXN_STATUS_WAIT);
-			if (swd_txn_status == TXN_STATUS_FAIL) {
-				r = -1;
-			} else {
-				r = swd_txn_status;
-			}
-			swd_txn_data = NULL;
-		} else {
+		t->status = TXN_STATUS_WAIT;
+		t->t_submit = swd_now_us();
+		swd->stats.txns++;
+		swd->stats.words_tx += t->txc;
+		swd->inflight[swd->inflight_count++] = t;
+		if ((r = link_write(swd, t->tx, t->txc))) {
+			q_retire(swd, t);
+			t->status = TXN_STATUS_FAIL;
 			r = -1;
 		}
 	}
-	pthread_mutex_unlock(&swd_lock);
-	if (r > 0) {
-		return process_reply(t, data + 1, (r / 4) - 1);
-	} else {
+	pthread_mutex_unlock(&swd->lock);
+	if (r)
+		ap_state_invalidate();
+	return r;
+}
+
+// wait for a submitted txn to complete, returning its status
+static int q_wait(struct txn *t) {
+	int r;
+	pthread_mutex_lock(&swd->lock);
+	while (t->status == TXN_STATUS_WAIT) {
+		pthread_cond_wait(&swd->event, &swd->lock);
+	}
+	r = (t->status == TXN_STATUS_DONE) ? t->result : -1;
+	pthread_mutex_unlock(&swd->lock);
+	if (r)
+		ap_state_invalidate();
+	return r;
+}
+
+static int q_exec(struct txn *t) {
+	if (q_submit(t))
 		return -1;
+	return q_wait(t);
+}
+
+// number of usb receive buffers kept posted to the probe
+#define RXBUFFERS		4
+
+// called from the usb event thread for every packet from the probe
+static void swd_rx(void *cookie, void *ptr, int r) {
+	struct swd_link *swd = cookie;
+	u32 *data = ptr;
+
+	capture_record((r < 0) ? CAP_ERR : CAP_RX, swd->index, ptr,
+		(r < 0) ? 0 : r);
+	pthread_mutex_lock(&swd->lock);
+	if (r < 0) {
+		if (swd->online != -1) {
+			xprintf(XSWD, "usb: debugger disconnected\n");
+			swd->online = -1;
+			while (swd->inflight_count > 0)
+				swd->inflight[--swd->inflight_count]->status = TXN_STATUS_FAIL;
+			pthread_cond_broadcast(&swd->event);
+		}
+	} else if ((r < 4) || (r & 3)) {
+		xprintf(XSWD, "usb: discard packet (%d)\n", r);
+	} else if (swd->query_id && (data[0] == swd->query_id)) {
+		swd->query_id = 0;
+		swd->query_reply_len = (r < sizeof(swd->query_reply)) ?
+			r : sizeof(swd->query_reply);
+		memcpy(swd->query_reply, data, swd->query_reply_len);
+		process_query(swd, data + 1, (r / 4) - 1);
+		swd->online = 1;
+		pthread_cond_broadcast(&swd->event);
+	} else if (data[0] == RSWD_TXN_ASYNC) {
+		pthread_mutex_unlock(&swd->lock);
+		process_async(swd, data + 1, (r / 4) - 1);
+		return;
+	} else if ((swd->inflight_count > 0) &&
+		(data[0] == swd->inflight[0]->id)) {
+		// replies arrive in the order txns were submitted
+		struct txn *t = swd->inflight[0];
+		t->result = process_reply(swd, t, data + 1, (r / 4) - 1);
+		t->status = TXN_STATUS_DONE;
+		stats_reply(swd, t->t_submit, t->result, r / 4);
+		q_retire(swd, t);
+		pthread_cond_broadcast(&swd->event);
+	} else {
+		xprintf(XSWD, "usb: rx: unexpected txn %08x (%d)\n", data[0], r);
 	}
+	pthread_mutex_unlock(&swd->lock);
 }
 
 static void *swd_reader(void *arg) {
-	uint32_t data[MAXWORDS];
-	unsigned query_id;
-	int r;
+	struct swd_link *swd = arg;
+	usb_handle *dev;
+	char serial[SERIALMAX];
+	u32 query[2];
 	int once = 1;
 restart:
 	for (;;) {
-		if ((usb = usb_open(0x1209, 0x5038, 0))) break;
-		if ((usb = usb_open(0x18d1, 0xdb03, 0))) break;
-		if ((usb = usb_open(0x18d1, 0xdb04, 0))) break;
+		if ((dev = usb_open_serial(0x1209, 0x5038, 0, swd->want))) break;
+		if ((dev = usb_open_serial(0x18d1, 0xdb03, 0, swd->want))) break;
+		if ((dev = usb_open_serial(0x18d1, 0xdb04, 0, swd->want))) break;
 		if (once) {
-			xprintf(XSWD, "usb: waiting for debugger device\n");
+			if (swd->want[0]) {
+				xprintf(XSWD, "usb: waiting for debugger %s\n", swd->want);
+			} else {
+				xprintf(XSWD, "usb: waiting for debugger device\n");
+			}
 			once = 0;
 		}
 		usleep(250000);
 	}
 	once = 0;
 	xprintf(XSWD, "usb: debugger connected\n");
+	usb_get_serial(dev, serial, sizeof(serial));
+	if (serial[0]) {
+		xprintf(XSWD, "usb: serial: %s\n", serial);
+	}
+
+	capture_record(CAP_OPEN, swd->index, serial, strlen(serial));
 
-	pthread_mutex_lock(&swd_lock);
+	pthread_mutex_lock(&swd->lock);
+	swd->usb = dev;
+	strcpy(swd->serial, serial);
 
 	// send a version query to find out about the firmware
 	// old m3debug fw will just report failure
- 	query_id = sequence++;
-	query_id = RSWD_TXN_START(query_id);
-	data[0] = query_id;
-	data[1] = RSWD_MSG(CMD_VERSION, 0, RSWD_VERSION);
-	usb_write(usb, data, 8);
+	swd->query_id = RSWD_TXN_START(swd->sequence++);
+	query[0] = swd->query_id;
+	query[1] = RSWD_MSG(CMD_VERSION, 0, RSWD_VERSION);
+
+	// receive buffers are posted before anything is sent, and
+	// are reposted as each completes, so the probe never stalls
+	// waiting for the host to be ready for a reply
+	pthread_mutex_unlock(&swd->lock);
+	capture_record(CAP_TX, swd->index, query, sizeof(query));
+	if (usb_start_rx(dev, RXBUFFERS, MAXWORDS * 4, swd_rx, swd) ||
+		(usb_queue_write(dev, query, sizeof(query)) != sizeof(query))) {
+		swd_rx(swd, NULL, -1);
+	}
+	pthread_mutex_lock(&swd->lock);
+
+	// everything from here happens in swd_rx until the link fails
+	while (swd->online != -1) {
+		pthread_cond_wait(&swd->event, &swd->lock);
+	}
+	// wait for a reader to ack the shutdown
+	while (swd->online == -1) {
+		pthread_cond_wait(&swd->event, &swd->lock);
+	}
+	pthread_mutex_unlock(&swd->lock);
+	usb_close(dev);
+	usleep(250000);
+	goto restart;
+	return NULL;
+}
+
+// stands in for swd_reader and the usb event thread when the probe
+// is behind an rswd-server, passing each packet to swd_rx as it comes
+// in, so pipelining and async SWO data work exactly as over usb
+static void *swd_remote(void *arg) {
+	struct swd_link *swd = arg;
+	u32 query[2];
+	u32 *data;
+	int once = 1;
+	int fd, r;
+
+	if ((data = malloc(MAXWORDS * 4)) == NULL) {
+		return NULL;
+	}
 	for (;;) {
-		pthread_mutex_unlock(&swd_lock);
-		r = usb_read_forever(usb, data, MAXWORDS * 4);
-		pthread_mutex_lock(&swd_lock);
-		if (r < 0) {
-			xprintf(XSWD, "usb: debugger disconnected\n");
-			swd_online = -1;
-			swd_txn_status = TXN_STATUS_FAIL;
-			pthread_cond_broadcast(&swd_event);
-			break;
-		}
-		if ((r < 4) || (r & 3)) {
-			xprintf(XSWD, "usb: discard packet (%d)\n", r);
+		if ((fd = socket_connect(swd->want)) < 0) {
+			if (once) {
+				xprintf(XSWD, "remote: waiting for %s\n", swd->want);
+				once = 0;
+			}
+			usleep(250000);
 			continue;
 		}
-		if (query_id && (data[0] == query_id)) {
-			query_id = 0;
-			process_query(data + 1, (r / 4) - 1);
-			swd_online = 1;
-		} else if (data[0] == RSWD_TXN_ASYNC) {
-			pthread_mutex_unlock(&swd_lock);
-			process_async(data + 1, (r / 4) - 1);
-			pthread_mutex_lock(&swd_lock);
-		} else if ((swd_txn_status == TXN_STATUS_WAIT) &&
-			(data[0] == swd_txn_id)) {
-			swd_txn_status = r;
-			memcpy(swd_txn_data, data, r);
-			pthread_cond_broadcast(&swd_event);
-		} else {
-			xprintf(XSWD, "usb: rx: unexpected txn %08x (%d)\n", data[0], r);
+		once = 0;
+		xprintf(XSWD, "remote: connected to %s\n", swd->want);
+		capture_record(CAP_OPEN, swd->index, swd->want, strlen(swd->want));
+
+		pthread_mutex_lock(&swd->lock);
+		swd->sock = fd;
+		strcpy(swd->serial, swd->want);
+		swd->query_id = RSWD_TXN_START(swd->sequence++);
+		query[0] = swd->query_id;
+		query[1] = RSWD_MSG(CMD_VERSION, 0, RSWD_VERSION);
+		r = link_write(swd, query, 2);
+		pthread_mutex_unlock(&swd->lock);
+
+		while ((r == 0) && ((r = socket_recv_frame(fd, data, MAXWORDS * 4)) >= 0)) {
+			swd_rx(swd, data, r);
+			r = 0;
+		}
+		swd_rx(swd, NULL, -1);
+
+		// wait for a reader to ack the disconnect
+		pthread_mutex_lock(&swd->lock);
+		while (swd->online == -1) {
+			pthread_cond_wait(&swd->event, &swd->lock);
+		}
+		pthread_mutex_unlock(&swd->lock);
+		close(fd);
+		usleep(250000);
+	}
+	return NULL;
+}
+
+// stands in for swd_reader and the usb event thread when txns are
+// answered in-process, handing each reply to swd_rx as if it had
+// come from usb, until the responder gives up
+static void *swd_local(void *arg) {
+	struct swd_link *swd = arg;
+	u32 query[2];
+	u32 *reply;
+	unsigned n;
+	int len;
+
+	if ((reply = malloc(MAXWORDS * 4)) == NULL) {
+		return NULL;
+	}
+	xprintf(XSWD, "%s: debugger connected\n", swd->want);
+	pthread_mutex_lock(&swd->lock);
+	strcpy(swd->serial, swd->want);
+	swd->query_id = RSWD_TXN_START(swd->sequence++);
+	query[0] = swd->query_id;
+	query[1] = RSWD_MSG(CMD_VERSION, 0, RSWD_VERSION);
+	link_write(swd, query, 2);
+	do {
+		while (swd->queue_count == 0) {
+			pthread_cond_wait(&swd->event, &swd->lock);
 		}
+		n = swd->queue_head;
+		pthread_mutex_unlock(&swd->lock);
+		len = swd->local(swd->local_cookie, swd->queue[n],
+			swd->queue_len[n], reply, MAXWORDS * 4);
+		swd_rx(swd, (len < 0) ? NULL : reply, len);
+		pthread_mutex_lock(&swd->lock);
+		swd->queue_head = (n + 1) % (MAXINFLIGHT + 1);
+		swd->queue_count--;
+	} while (len >= 0);
+
+	// wait for a reader to ack the end
+	while (swd->online == -1) {
+		pthread_cond_wait(&swd->event, &swd->lock);
 	}
-	// wait for a reader to ack the shutdown (and close usb)
-	while (swd_online == -1) {
-		pthread_cond_wait(&swd_event, &swd_lock);
+	pthread_mutex_unlock(&swd->lock);
+	if (swd->replay) {
+		replay_status(swd->replay);
 	}
-	pthread_mutex_unlock(&swd_lock);
-	usleep(250000);
-	goto restart;
+	free(reply);
 	return NULL;
 }
 
@@ -445,24 +854,65 @@ static void q_check(struct txn *t, int n) {
 	}
 }
 
-static void q_init(struct txn *t) {
+#define SWD_WR(a,n) RSWD_MSG(CMD_SWD_WRITE, OP_WR | (a), (n))
+#define SWD_RD(a,n) RSWD_MSG(CMD_SWD_READ, OP_RD | (a), (n))
+#define SWD_RX(a,n) RSWD_MSG(CMD_SWD_DISCARD, OP_RD | (a), (n))
+
+// for probe commands that do not talk to a DP
+static void q_init_raw(struct txn *t) {
 	t->magic = 0x12345678;
 	t->txc = 1;
 	t->rxc = 0;
-	t->cache_apaddr = 0xffffffff;
-	t->cache_ahbtar = 0xffffffff;
 }
 
-#define SWD_WR(a,n) RSWD_MSG(CMD_SWD_WRITE, OP_WR | (a), (n))
-#define SWD_RD(a,n) RSWD_MSG(CMD_SWD_READ, OP_RD | (a), (n))
-#define SWD_RX(a,n) RSWD_MSG(CMD_SWD_DISCARD, OP_RD | (a), (n))
+// if another DP on a multi-drop bus was used last, switch to ours
+// first: line reset, TARGETSEL (which is not acked), and a DPIDR read
+// which is required before the DP will accept anything else
+static void q_init(struct txn *t) {
+	struct swd_dp *dp = swd->dp;
+	q_init_raw(t);
+	if (swd->wire == dp) {
+		return;
+	}
+	if (dp->on) {
+		t->tx[t->txc++] = RSWD_MSG(CMD_ATTACH, ATTACH_SWD_RESET, 0);
+		t->tx[t->txc++] = SWD_WR(DP_BUFFER, 1);
+		t->tx[t->txc++] = dp->targetsel;
+		t->tx[t->txc++] = SWD_RD(DP_IDCODE, 1);
+		t->rx[t->rxc++] = &swd->wire_idcode;
+		// SELECT survives, but do not count on it
+		dp->ap.select = 0xffffffff;
+	}
+	swd->wire = dp;
+}
+
+static u32 swd_wrapsize_override = 0;
+
+#define CSW_SINGLE (AHB_CSW_MDEBUG | AHB_CSW_PRIV | AHB_CSW_DBG_EN | \
+	AHB_CSW_32BIT)
+#define CSW_BULK (AHB_CSW_MDEBUG | AHB_CSW_PRIV | AHB_CSW_INC_SINGLE | \
+	AHB_CSW_DBG_EN | AHB_CSW_32BIT)
+
+// account for DRW accesses covering len bytes from TAR
+static void ap_state_advance(u32 len) {
+	u32 tar = swd->dp->ap.tar;
+	if (((swd->dp->ap.csw & 0x30) == AHB_CSW_INC_NONE) || (tar == 0xffffffff))
+		return;
+	// once it reaches a wrap boundary, we are no longer sure
+	if (((tar ^ (tar + len)) & ~(swd->dp->wrapsize - 1)) ||
+		(((tar + len) & (swd->dp->wrapsize - 1)) == 0)) {
+		swd->dp->ap.tar = 0xffffffff;
+	} else {
+		swd->dp->ap.tar = tar + len;
+	}
+}
 
 static void q_ap_select(struct txn *t, u32 addr) {
 	addr &= 0xF0;
-	if (t->cache_apaddr != addr) {
+	if (swd->dp->ap.select != addr) {
 		t->tx[t->txc++] = SWD_WR(DP_SELECT, 1);
 		t->tx[t->txc++] = addr;
-		t->cache_apaddr = addr;
+		swd->dp->ap.select = addr;
 	}
 }
 
@@ -471,6 +921,13 @@ static void q_ap_write(struct txn *t, u32 addr, u32 value) {
 	q_ap_select(t, addr);
 	t->tx[t->txc++] = SWD_WR(OP_AP | (addr & 0xC), 1);
 	t->tx[t->txc++] = value;
+	if (addr == AHB_CSW) {
+		swd->dp->ap.csw = value;
+	} else if (addr == AHB_TAR) {
+		swd->dp->ap.tar = value;
+	} else if (addr == AHB_DRW) {
+		ap_state_advance(4);
+	}
 }
 
 static void q_ap_read(struct txn *t, u32 addr, u32 *value) {
@@ -479,22 +936,33 @@ static void q_ap_read(struct txn *t, u32 addr, u32 *value) {
 	t->tx[t->txc++] = SWD_RX(OP_AP | (addr & 0xC), 1);
 	t->tx[t->txc++] = SWD_RD(DP_BUFFER, 1);
 	t->rx[t->rxc++] = value;
+	if (addr == AHB_DRW) {
+		ap_state_advance(4);
+	}
 }
 
-static void q_ahb_write(struct txn *t, u32 addr, u32 value) {
-//	xprintf(XSWD, "WR %08x -> %08x\n", value, addr);
-	if (t->cache_ahbtar != addr) {
+static void q_ahb_csw(struct txn *t, u32 csw) {
+	if (swd->dp->ap.csw != csw) {
+		q_ap_write(t, AHB_CSW, csw);
+	}
+}
+
+static void q_ahb_tar(struct txn *t, u32 addr) {
+	if (swd->dp->ap.tar != addr) {
 		q_ap_write(t, AHB_TAR, addr);
-		t->cache_ahbtar = addr;
 	}
+}
+
+static void q_ahb_write(struct txn *t, u32 addr, u32 value) {
+//	xprintf(XSWD, "WR %08x -> %08x\n", value, addr);
+	q_ahb_csw(t, CSW_SINGLE);
+	q_ahb_tar(t, addr);
 	q_ap_write(t, AHB_DRW, value);
 }
 
 static void q_ahb_read(struct txn *t, u32 addr, u32 *value) {
-	if (t->cache_ahbtar != addr) {
-		q_ap_write(t, AHB_TAR, addr);
-		t->cache_ahbtar = addr;
-	}
+	q_ahb_csw(t, CSW_SINGLE);
+	q_ahb_tar(t, addr);
 	q_ap_read(t, AHB_DRW, value);
 }
 
@@ -526,6 +994,68 @@ static int _swdp_ahb_write(u32 addr, u32 value) {
 	return q_exec(&t);
 }
 
+#define MAXDATAWORDS (swd->maxwords - 16)
+
+/* Bulk transfers and batches are split into txns that are streamed
+ * to the probe back to back, with up to MAXINFLIGHT chunks outstanding, so the probe
+ * never idles waiting on a host round trip between chunks.
+ */
+struct pipeline {
+	struct txn t[MAXINFLIGHT];
+	unsigned submitted;
+	unsigned completed;
+	int status;
+};
+
+static void q_pipe_init(struct pipeline *p) {
+	p->submitted = 0;
+	p->completed = 0;
+	p->status = 0;
+}
+
+// returns the next free txn, waiting for the oldest to finish if needed
+static struct txn *q_pipe_slot(struct pipeline *p) {
+	struct txn *t = p->t + (p->submitted % MAXINFLIGHT);
+	if ((p->submitted - p->completed) == MAXINFLIGHT) {
+		if (q_wait(t))
+			p->status = -1;
+		p->completed++;
+	}
+	return t;
+}
+
+// the AP state the shadow expects is only certain once every txn
+// before this one has completed successfully; if one still in flight
+// fails, TAR and CSW are unknown, and a chunk that relied on them
+// would auto-increment from the wrong address
+static struct txn *q_pipe_next(struct pipeline *p) {
+	struct txn *t = q_pipe_slot(p);
+	if ((p->submitted != p->completed) || p->status) {
+		swd->dp->ap.select = 0xffffffff;
+		swd->dp->ap.csw = 0xffffffff;
+		swd->dp->ap.tar = 0xffffffff;
+	}
+	q_init(t);
+	return t;
+}
+
+static void q_pipe_submit(struct pipeline *p, struct txn *t) {
+	if (q_submit(t)) {
+		p->status = -1;
+	} else {
+		p->submitted++;
+	}
+}
+
+static int q_pipe_finish(struct pipeline *p) {
+	while (p->completed != p->submitted) {
+		if (q_wait(p->t + (p->completed % MAXINFLIGHT)))
+			p->status = -1;
+		p->completed++;
+	}
+	return p->status;
+}
+
 #if 0
 /* simpler but far less optimal. keeping against needing to debug */
 int _swdp_ahb_read32(u32 addr, u32 *out, int count) {
@@ -561,105 +1091,227 @@ int _swdp_ahb_write32(u32 addr, u32 *in, int count) {
 }
 #else
 
-// some implementations support >10 bits, but 10 is the minimum required
-// by spec (and some targets like rp2040 are limited to this)
-// TODO: detect this support 0x1000 or higher on targets that can handle it
-#define WRAPSIZE 0x400
-#define WRAPMASK (WRAPSIZE - 1)
-
-#define MAXDATAWORDS (swd_maxwords - 16)
 /* 10 txns overhead per 128 read txns - 126KB/s on 72MHz STM32F
  * 8 txns overhead per 128 write txns - 99KB/s on 72MHz STM32F
  */
 static int _swdp_ahb_read32(u32 addr, u32 *out, int count) {
-	struct txn t;
+	struct pipeline p;
+	struct txn *t;
 
-	while (count > 0) {
+	q_pipe_init(&p);
+	while ((count > 0) && (p.status == 0)) {
 		int xfer;
 
 		// limit transfer so we won't cross a wrap boundary
-		xfer = (WRAPSIZE - (addr & WRAPMASK)) / 4;
+		xfer = (swd->dp->wrapsize - (addr & (swd->dp->wrapsize - 1))) / 4;
 		if (xfer > count)
 			xfer = count;
 		if (xfer > MAXDATAWORDS)
 			xfer = MAXDATAWORDS;
 
 		count -= xfer;
-		q_init(&t);
+		t = q_pipe_next(&p);
 
-		/* setup before initial txn */
-		q_ap_write(&t, AHB_CSW,
-			AHB_CSW_MDEBUG | AHB_CSW_PRIV | AHB_CSW_INC_SINGLE |
-			AHB_CSW_DBG_EN | AHB_CSW_32BIT);
-
-		/* initial address */
-		q_ap_write(&t, AHB_TAR, addr);
+		/* setup, unless left that way by a completed txn */
+		q_ahb_csw(t, CSW_BULK);
+		q_ahb_tar(t, addr);
+		q_ap_select(t, AHB_DRW);
+		ap_state_advance(xfer * 4);
 		addr += xfer * 4;
 
 		/* kick off first read, ignore result, as the
 		 * real result will show up during the *next* read
 		 */
-		t.tx[t.txc++] = SWD_RX(OP_AP | (AHB_DRW & 0xC), 1);
-		t.tx[t.txc++] = SWD_RD(OP_AP | (AHB_DRW & 0xC), xfer -1);
+		t->tx[t->txc++] = SWD_RX(OP_AP | (AHB_DRW & 0xC), 1);
+		t->tx[t->txc++] = SWD_RD(OP_AP | (AHB_DRW & 0xC), xfer -1);
 		while (xfer-- > 1)
-			t.rx[t.rxc++] = out++;
-		t.tx[t.txc++] = SWD_RD(DP_BUFFER, 1);
-		t.rx[t.rxc++] = out++;
-
-		/* restore state after last batch */
-		if (count == 0)
-			q_ap_write(&t, AHB_CSW,
-				AHB_CSW_MDEBUG | AHB_CSW_PRIV |
-				AHB_CSW_DBG_EN | AHB_CSW_32BIT);
+			t->rx[t->rxc++] = out++;
+		t->tx[t->txc++] = SWD_RD(DP_BUFFER, 1);
+		t->rx[t->rxc++] = out++;
 
-		if (q_exec(&t))
-			return -1;
+		q_pipe_submit(&p, t);
 	}
-	return 0;
+	return q_pipe_finish(&p);
 }
 
 static int _swdp_ahb_write32(u32 addr, u32 *in, int count) {
-	struct txn t;
+	struct pipeline p;
+	struct txn *t;
 
-	while (count > 0) {
+	q_pipe_init(&p);
+	while ((count > 0) && (p.status == 0)) {
 		int xfer;
 
 		// limit transfer so we won't cross a wrap boundary
-		xfer = (WRAPSIZE - (addr & WRAPMASK)) / 4;
+		xfer = (swd->dp->wrapsize - (addr & (swd->dp->wrapsize - 1))) / 4;
 		if (xfer > count)
 			xfer = count;
 		if (xfer > MAXDATAWORDS)
 			xfer = MAXDATAWORDS;
 
 		count -= xfer;
-		q_init(&t);
+		t = q_pipe_next(&p);
 
-		/* setup before initial txn */
-		q_ap_write(&t, AHB_CSW,
-			AHB_CSW_MDEBUG | AHB_CSW_PRIV | AHB_CSW_INC_SINGLE |
-			AHB_CSW_DBG_EN | AHB_CSW_32BIT);
+		/* setup, unless left that way by a completed txn */
+		q_ahb_csw(t, CSW_BULK);
+		q_ahb_tar(t, addr);
+		q_ap_select(t, AHB_DRW);
+		ap_state_advance(xfer * 4);
 
-		/* initial address */
-		q_ap_write(&t, AHB_TAR, addr);
-
-		t.tx[t.txc++] = SWD_WR(OP_AP | (AHB_DRW & 0xC), xfer);
+		t->tx[t->txc++] = SWD_WR(OP_AP | (AHB_DRW & 0xC), xfer);
 		addr += xfer * 4;
 		while (xfer-- > 0) 
-			t.tx[t.txc++] = *in++;
-
-		/* restore state after last batch */
-		if (count == 0)
-			q_ap_write(&t, AHB_CSW,
-				AHB_CSW_MDEBUG | AHB_CSW_PRIV |
-				AHB_CSW_DBG_EN | AHB_CSW_32BIT);
+			t->tx[t->txc++] = *in++;
 
-		if (q_exec(&t))
-			return -1;
+		q_pipe_submit(&p, t);
 	}
-	return 0;
+	return q_pipe_finish(&p);
 }
 #endif
 
+// worst case words per op: SELECT, TAR, and DRW with RDBUFF
+#define BATCHOPWORDS 8
+
+static int _swdp_batch(debug_batch_op *op, unsigned count) {
+	struct pipeline p;
+	struct txn *t = NULL;
+
+	q_pipe_init(&p);
+	while ((count > 0) && (p.status == 0)) {
+		if (t == NULL)
+			t = q_pipe_next(&p);
+		if (op->op == BATCH_WR) {
+			q_ahb_write(t, op->addr, op->value);
+		} else {
+			q_ahb_read(t, op->addr, op->out);
+		}
+		op++;
+		count--;
+		if ((count == 0) || ((t->txc + BATCHOPWORDS) > MAXDATAWORDS)) {
+			q_pipe_submit(&p, t);
+			t = NULL;
+		}
+	}
+	return q_pipe_finish(&p);
+}
+
+static u32 csw_sized(unsigned size, int packed) {
+	return AHB_CSW_MDEBUG | AHB_CSW_PRIV | AHB_CSW_DBG_EN |
+		(packed ? AHB_CSWINC_PACKED : AHB_CSW_INC_SINGLE) |
+		((size == 1) ? AHB_CSW_8BIT : AHB_CSW_16BIT);
+}
+
+/* 8/16bit transfers: each DRW access moves one item on its byte lanes,
+ * or, when the AP supports packing and the range is whole words, one
+ * word's worth of items (so the data is simply the words in memory)
+ */
+static int _swdp_mem_rd_c(u32 addr, void *data, int count, unsigned size) {
+	struct pipeline p;
+	struct txn *t;
+	u32 *buf, *out;
+	u32 csw, step;
+	int packed, total, n;
+
+	if (size == 4)
+		return _swdp_ahb_read32(addr, data, count);
+
+	packed = swd->dp->packed && !(addr & 3) && !((count * size) & 3);
+	step = packed ? 4 : size;
+	total = (count * size) / step;
+	csw = csw_sized(size, packed);
+	if ((buf = malloc(total * 4)) == NULL)
+		return -1;
+
+	q_pipe_init(&p);
+	for (n = total, out = buf; (n > 0) && (p.status == 0); ) {
+		int xfer;
+
+		xfer = (swd->dp->wrapsize - (addr & (swd->dp->wrapsize - 1))) / step;
+		if (xfer > n)
+			xfer = n;
+		if (xfer > MAXDATAWORDS)
+			xfer = MAXDATAWORDS;
+
+		n -= xfer;
+		t = q_pipe_next(&p);
+		q_ahb_csw(t, csw);
+		q_ahb_tar(t, addr);
+		q_ap_select(t, AHB_DRW);
+		ap_state_advance(xfer * step);
+		addr += xfer * step;
+
+		t->tx[t->txc++] = SWD_RX(OP_AP | (AHB_DRW & 0xC), 1);
+		if (xfer > 1)
+			t->tx[t->txc++] = SWD_RD(OP_AP | (AHB_DRW & 0xC), xfer - 1);
+		while (xfer-- > 1)
+			t->rx[t->rxc++] = out++;
+		t->tx[t->txc++] = SWD_RD(DP_BUFFER, 1);
+		t->rx[t->rxc++] = out++;
+
+		q_pipe_submit(&p, t);
+	}
+	if (q_pipe_finish(&p) == 0) {
+		addr -= total * step;
+		if (packed) {
+			memcpy(data, buf, count * size);
+		} else {
+			u8 *x = data;
+			for (n = 0; n < total; n++) {
+				u32 v = buf[n] >> (8 * ((addr + n * size) & 3));
+				memcpy(x + n * size, &v, size);
+			}
+		}
+	}
+	free(buf);
+	return p.status;
+}
+
+static int _swdp_mem_wr_c(u32 addr, const void *data, int count, unsigned size) {
+	struct pipeline p;
+	struct txn *t;
+	const u8 *in = data;
+	u32 csw, step;
+	int packed, n;
+
+	if (size == 4)
+		return _swdp_ahb_write32(addr, (void*) data, count);
+
+	packed = swd->dp->packed && !(addr & 3) && !((count * size) & 3);
+	step = packed ? 4 : size;
+	n = (count * size) / step;
+	csw = csw_sized(size, packed);
+
+	q_pipe_init(&p);
+	while ((n > 0) && (p.status == 0)) {
+		int xfer;
+
+		xfer = (swd->dp->wrapsize - (addr & (swd->dp->wrapsize - 1))) / step;
+		if (xfer > n)
+			xfer = n;
+		if (xfer > MAXDATAWORDS)
+			xfer = MAXDATAWORDS;
+
+		n -= xfer;
+		t = q_pipe_next(&p);
+		q_ahb_csw(t, csw);
+		q_ahb_tar(t, addr);
+		q_ap_select(t, AHB_DRW);
+		ap_state_advance(xfer * step);
+
+		t->tx[t->txc++] = SWD_WR(OP_AP | (AHB_DRW & 0xC), xfer);
+		while (xfer-- > 0) {
+			u32 v = 0;
+			memcpy(&v, in, step);
+			t->tx[t->txc++] = packed ? v : (v << (8 * (addr & 3)));
+			addr += step;
+			in += step;
+		}
+
+		q_pipe_submit(&p, t);
+	}
+	return q_pipe_finish(&p);
+}
+
 #if 0
 int swdp_core_write(u32 n, u32 v) {
 	struct txn t;
@@ -816,36 +1468,191 @@ int swdp_watchpoint_disable(unsigned n) {
 
 int swdp_bootloader(void) {
 	struct txn t;
-	q_init(&t);
+	q_init_raw(&t);
 	t.tx[t.txc++] = RSWD_MSG(CMD_BOOTLOADER, 0, 0);
 	return q_exec(&t);
 }
 
-static uint32_t targetsel_val = 0;
-static unsigned targetsel_on = 0;
+int swdp_targetsel(uint32_t val, unsigned on) {
+	struct swd_dp *dp;
+	unsigned n;
+	for (n = 0; n < swd->dp_count; n++) {
+		dp = swd->dps + n;
+		if ((dp->on == on) && (!on || (dp->targetsel == val))) {
+			swd->dp = dp;
+			return 0;
+		}
+	}
+	if (swd->dp_count == MAXDPS) {
+		xprintf(XSWD, "swd: too many DPs\n");
+		return -1;
+	}
+	dp = swd->dps + swd->dp_count++;
+	dp_state_init(dp, val, on);
+	swd->dp = dp;
+	return 0;
+}
+
+int swdp_dp_attached(void) {
+	return swd->dp->attached;
+}
+
+void swdp_dp_list(void) {
+	unsigned n;
+	for (n = 0; n < swd->dp_count; n++) {
+		struct swd_dp *dp = swd->dps + n;
+		char sel[16];
+		if (dp->on) {
+			sprintf(sel, "%08x", dp->targetsel);
+		} else {
+			strcpy(sel, "-");
+		}
+		xprintf(XDATA, "%c %-8s  idcode %08x  wrap %x%s%s\n",
+			(dp == swd->dp) ? '*' : ' ', sel, dp->idcode,
+			dp->wrapsize, dp->packed ? ", packed" : "",
+			dp->attached ? "" : ", detached");
+	}
+}
+
+/* SWCLK rates found by autoclock, per probe serial and target IDCODE,
+ * applied on later attaches to the same pair.  Only kept for this
+ * debugger session: a new session starts at the default clock again.
+ */
+#define CLOCKCACHE 16
+
+static struct {
+	char serial[SERIALMAX];
+	u32 idcode;
+	unsigned khz;
+} swd_clocks[CLOCKCACHE];
+static unsigned swd_clocks_count = 0;
+static int swd_autoclock_busy = 0;
+
+static int clock_cache_find(u32 idcode) {
+	unsigned n;
+	for (n = 0; n < swd_clocks_count; n++) {
+		if ((swd_clocks[n].idcode == idcode) &&
+			!strcmp(swd_clocks[n].serial, swd->serial)) {
+			return n;
+		}
+	}
+	return -1;
+}
+
+static void clock_cache_drop(u32 idcode) {
+	int n = clock_cache_find(idcode);
+	if (n >= 0) {
+		swd_clocks_count--;
+		memmove(swd_clocks + n, swd_clocks + n + 1,
+			(swd_clocks_count - n) * sizeof(swd_clocks[0]));
+	}
+}
+
+static void clock_cache_store(u32 idcode, unsigned khz) {
+	clock_cache_drop(idcode);
+	if (swd_clocks_count == CLOCKCACHE) {
+		// forget the oldest
+		swd_clocks_count--;
+		memmove(swd_clocks, swd_clocks + 1,
+			swd_clocks_count * sizeof(swd_clocks[0]));
+	}
+	strcpy(swd_clocks[swd_clocks_count].serial, swd->serial);
+	swd_clocks[swd_clocks_count].idcode = idcode;
+	swd_clocks[swd_clocks_count].khz = khz;
+	swd_clocks_count++;
+}
+
+static int _swdp_set_clock(unsigned khz) {
+	struct txn t;
+	if (khz > 0xFFFF)
+		return -1;
+	if (khz < 1000)
+		khz = 1000;
+	swd->clock_actual = 0;
+	q_init_raw(&t);
+	t.tx[t.txc++] = RSWD_MSG(CMD_SET_CLOCK, 0, khz);
+	if (q_exec(&t))
+		return -1;
+	// older firmware does not report the rate it settled on
+	if (swd->clock_actual == 0)
+		swd->clock_actual = khz;
+	swd->clock_khz = khz;
+	return 0;
+}
+
+void swdp_set_wrapsize(u32 size) {
+	swd_wrapsize_override = size;
+	if (size)
+		swd->dp->wrapsize = size;
+	ap_state_invalidate();
+}
 
-void swdp_targetsel(uint32_t val, unsigned on) {
-	targetsel_val = val;
-	targetsel_on = on;
+u32 swdp_get_wrapsize(void) {
+	return swd->dp->wrapsize;
+}
+
+static int _swdp_clear_error(void);
+
+/* Start a single auto-incrementing read on the last word of the ROM
+ * table (present on every Cortex-M) and see where TAR ends up: if it
+ * wrapped, the distance back is the auto-increment size (anything past
+ * the 4K boundary we are testing counts as 4K).  Only the one word is
+ * accessed.  Then see if CSW will hold packed byte transfers, which
+ * are optional.
+ */
+static void swdp_probe_ap(void) {
+	struct txn t;
+	u32 addr = 0xE00FFFFC;
+	u32 data, tar, csw;
+
+	swd->dp->wrapsize = WRAPSIZE_MIN;
+	swd->dp->packed = 0;
+
+	q_init(&t);
+	q_ap_write(&t, AHB_CSW, CSW_BULK);
+	q_ap_write(&t, AHB_TAR, addr);
+	q_ap_read(&t, AHB_DRW, &data);
+	q_ap_read(&t, AHB_TAR, &tar);
+	q_ap_write(&t, AHB_CSW,
+		AHB_CSW_MDEBUG | AHB_CSW_PRIV | AHB_CSWINC_PACKED |
+		AHB_CSW_DBG_EN | AHB_CSW_8BIT);
+	q_ap_read(&t, AHB_CSW, &csw);
+	q_ap_write(&t, AHB_CSW, CSW_SINGLE);
+	if (q_exec(&t)) {
+		_swdp_clear_error();
+		return;
+	}
+	tar = (addr + 4) - tar;
+	if ((tar == 0) || (tar > WRAPSIZE_MAX)) {
+		swd->dp->wrapsize = WRAPSIZE_MAX;
+	} else if ((tar >= WRAPSIZE_MIN) && !(tar & (tar - 1))) {
+		swd->dp->wrapsize = tar;
+	}
+	swd->dp->packed = ((csw & 0x37) == (AHB_CSWINC_PACKED | AHB_CSW_8BIT));
 }
 
 static int _swdp_reset(void) {
 	struct txn t;
 	u32 n, idcode;
+	int cc;
 
-	swd_error = 0;
-	q_init(&t);
+	swd->error = 0;
+	swd->stats.attaches++;
+	swd->dp->attached = 0;
+	ap_state_invalidate();
+	q_init_raw(&t);
 	t.tx[t.txc++] = RSWD_MSG(CMD_ATTACH, ATTACH_JTAG_TO_SWD, 0);
 	t.tx[t.txc++] = RSWD_MSG(CMD_ATTACH, ATTACH_DORMANT_TO_SWD, 0);
 	t.tx[t.txc++] = RSWD_MSG(CMD_ATTACH, ATTACH_SWD_RESET, 0);
 
-	if (targetsel_on) {
+	if (swd->dp->on) {
 		t.tx[t.txc++] = SWD_WR(DP_BUFFER, 1);
-		t.tx[t.txc++] = targetsel_val;
+		t.tx[t.txc++] = swd->dp->targetsel;
 	}
 	
 	t.tx[t.txc++] = SWD_RD(DP_IDCODE, 1);
 	t.rx[t.rxc++] = &idcode;
+	swd->wire = swd->dp;
 	if (q_exec(&t)) {
 		if (swd_verbose) {
 			xprintf(XSWD, "attach: IDCODE: ????????\n");
@@ -854,16 +1661,25 @@ static int _swdp_reset(void) {
 		if (swd_verbose) {
 			xprintf(XSWD, "attach: IDCODE: %08x\n", idcode);
 		}
+		swd->dp->idcode = idcode;
+		if (!swd_autoclock_busy && ((cc = clock_cache_find(idcode)) >= 0) &&
+			(swd_clocks[cc].khz != swd->clock_khz)) {
+			if (swd_verbose) {
+				xprintf(XSWD, "attach: SWCLK %d KHz (autoclock)\n",
+					swd_clocks[cc].khz);
+			}
+			_swdp_set_clock(swd_clocks[cc].khz);
+		}
 	}
 
-	swd_error = 0;
+	swd->error = 0;
 	q_init(&t);
 
  	/* clear any stale errors */
 	t.tx[t.txc++] = SWD_WR(DP_ABORT, 1);
 	t.tx[t.txc++] = 0x1E;
 
-	if (targetsel_on && (targetsel_val == 0xf1002927)) {
+	if (swd->dp->on && (swd->dp->targetsel == 0xf1002927)) {
 		// for pico recovery dap, only valid action is clear
 		// debug power bits to put the chip in to recovery mode
 		t.tx[t.txc++] = SWD_WR(DP_DPCTRL, 1);
@@ -891,49 +1707,173 @@ static int _swdp_reset(void) {
 	if (swd_verbose) {
 		xprintf(XSWD, "attach: DPCTRL: %08x\n", n);
 	}
+
+	if (swd->dp->on && (swd->dp->targetsel == 0xf1002927)) {
+		swd->dp->wrapsize = WRAPSIZE_MIN;
+		swd->dp->packed = 0;
+	} else {
+		swdp_probe_ap();
+		if (swd_verbose) {
+			xprintf(XSWD, "attach: TAR wrap: %x%s\n", swd->dp->wrapsize,
+				swd->dp->packed ? ", packed" : "");
+		}
+	}
+	if (swd_wrapsize_override) {
+		swd->dp->wrapsize = swd_wrapsize_override;
+	}
+	swd->dp->attached = 1;
 	//xprintf(XSWD, "attach: BASE: %08x\n", base);
 	return 0;
 }
 
 static int _swdp_clear_error(void) {
-	if (swd_error == 0) {
+	if (swd->error == 0) {
 		return 0;
 	} else {
 		struct txn t;
-		swd_error = 0;
+		swd->error = 0;
+		swd->stats.recoveries++;
+		ap_state_invalidate();
 
 		q_init(&t);
 		t.tx[t.txc++] = SWD_WR(DP_ABORT, 1);
 		t.tx[t.txc++] = 0x1E;
 		q_exec(&t);
 
-		return swd_error;
+		return swd->error;
 	}
 }
 
 void swdp_enable_tracing(int yes) {
 	struct txn t;
-	q_init(&t);
+	q_init_raw(&t);
 	t.tx[t.txc++] = RSWD_MSG(CMD_TRACE, yes, 0);
 	q_exec(&t);
 }
 
 void swdp_target_reset(int enable) {
 	struct txn t;
-	q_init(&t);
+	q_init_raw(&t);
 	t.tx[t.txc++] = RSWD_MSG(CMD_RESET, 0, enable);
 	q_exec(&t);
 }
 
 int swdp_set_clock(unsigned khz) {
+	// an explicit rate replaces any autoclock result
+	clock_cache_drop(swd->dp->idcode);
+	return _swdp_set_clock(khz);
+}
+
+#define CLOCKTEST_WORDS 256
+
+// IDCODE reads plus write/readback patterns over the scratch area
+static int swdp_clock_test(u32 scratch) {
+	u32 id[8], wr[CLOCKTEST_WORDS], rd[CLOCKTEST_WORDS];
+	unsigned n, pass;
 	struct txn t;
-	if (khz > 0xFFFF)
-		return -1;
-	if (khz < 1000)
-		khz = 1000;
+
 	q_init(&t);
-	t.tx[t.txc++] = RSWD_MSG(CMD_SET_CLOCK, 0, khz);
-	return q_exec(&t);
+	for (n = 0; n < 8; n++) {
+		t.tx[t.txc++] = SWD_RD(DP_IDCODE, 1);
+		t.rx[t.rxc++] = id + n;
+	}
+	if (q_exec(&t))
+		return -1;
+	for (n = 0; n < 8; n++) {
+		if (id[n] != swd->dp->idcode)
+			return -1;
+	}
+	for (pass = 0; pass < 3; pass++) {
+		for (n = 0; n < CLOCKTEST_WORDS; n++) {
+			switch (pass) {
+			case 0: // alternating bits
+				wr[n] = (n & 1) ? 0x55555555 : 0xAAAAAAAA;
+				break;
+			case 1: // walking ones and zeros
+				wr[n] = (1 << (n & 31)) ^ ((n & 32) ? 0xFFFFFFFF : 0);
+				break;
+			default: // something address dependent
+				wr[n] = (scratch + n * 4) * 0x9E3779B1;
+				break;
+			}
+		}
+		if (_swdp_ahb_write32(scratch, wr, CLOCKTEST_WORDS))
+			return -1;
+		if (_swdp_ahb_read32(scratch, rd, CLOCKTEST_WORDS))
+			return -1;
+		if (memcmp(wr, rd, sizeof(wr)))
+			return -1;
+	}
+	return 0;
+}
+
+/* Step SWCLK up until the link test fails (or the probe will not go
+ * any faster), then settle a margin below the first failure.  The
+ * scratch area contents are saved and restored.
+ */
+int swdp_autoclock(u32 scratch, unsigned max_khz) {
+	static const unsigned steps[] = {
+		1000, 2000, 4000, 6000, 8000, 10000, 12000, 16000,
+		20000, 24000, 30000, 40000, 50000, 60000,
+	};
+	u32 save[CLOCKTEST_WORDS];
+	unsigned n, khz, good = 0, fail = 0, last = 0;
+	int r = -1;
+
+	if (scratch & 3)
+		return -1;
+
+	swd_autoclock_busy = 1;
+	if (_swdp_set_clock(steps[0]) || _swdp_reset())
+		goto done;
+	if (_swdp_ahb_read32(scratch, save, CLOCKTEST_WORDS)) {
+		xprintf(XSWD, "autoclock: cannot read scratch area at %08x\n", scratch);
+		goto done;
+	}
+	clock_cache_drop(swd->dp->idcode);
+
+	for (n = 0; n < (sizeof(steps) / sizeof(steps[0])); n++) {
+		if (steps[n] > max_khz)
+			break;
+		if (_swdp_set_clock(steps[n]))
+			break;
+		if (swd->clock_actual <= last) {
+			// the probe is already as fast as it goes
+			break;
+		}
+		last = swd->clock_actual;
+		if (swdp_clock_test(scratch)) {
+			fail = steps[n];
+			break;
+		}
+		good = steps[n];
+	}
+
+	khz = good;
+	if (fail && (khz > (fail * 3 / 4)))
+		khz = fail * 3 / 4;
+	if (khz < steps[0])
+		khz = steps[0];
+
+	// confirm the choice from a fresh attach
+	if (_swdp_set_clock(khz) || _swdp_reset() || swdp_clock_test(scratch)) {
+		xprintf(XSWD, "autoclock: link unreliable at %d KHz\n", khz);
+		if (_swdp_set_clock(steps[0]) || _swdp_reset())
+			goto done;
+	} else {
+		clock_cache_store(swd->dp->idcode, khz);
+		if (fail) {
+			xprintf(XSWD, "autoclock: SWCLK %d KHz (failed at %d KHz)\n", khz, fail);
+		} else {
+			xprintf(XSWD, "autoclock: SWCLK %d KHz (fastest tried)\n", khz);
+		}
+		r = 0;
+	}
+	if (_swdp_ahb_write32(scratch, save, CLOCKTEST_WORDS))
+		r = -1;
+done:
+	swd_autoclock_busy = 0;
+	return r;
 }
 
 int swo_set_clock(unsigned khz) {
@@ -942,30 +1882,218 @@ int swo_set_clock(unsigned khz) {
 		return -1;
 	if (khz < 1000)
 		khz = 1000;
-	q_init(&t);
+	q_init_raw(&t);
 	t.tx[t.txc++] = RSWD_MSG(CMD_SWO_CLOCK, 0, khz);
 	return q_exec(&t);
 }
 
-int swdp_open(void) {
-	pthread_create(&swd_thread, NULL, swd_reader, NULL);
+static struct swd_link *swdp_link_find(const char *serial) {
+	unsigned n;
+	for (n = 0; n < swd_links_count; n++) {
+		if (!strcmp(swd_links[n]->want, serial) ||
+			(serial[0] && !strcmp(swd_links[n]->serial, serial))) {
+			return swd_links[n];
+		}
+	}
+	return NULL;
+}
+
+static struct swd_link *swdp_link_new(const char *serial,
+	swd_local_fn local, void *cookie) {
+	struct swd_link *l;
+
+	if (swd_links_count == MAXLINKS) {
+		xprintf(XSWD, "usb: too many probes\n");
+		return NULL;
+	}
+	if ((l = calloc(1, sizeof(*l))) == NULL) {
+		return NULL;
+	}
+	if (local && ((l->queue = malloc(sizeof(l->queue[0]) *
+		(MAXINFLIGHT + 1))) == NULL)) {
+		free(l);
+		return NULL;
+	}
+	pthread_mutex_init(&l->lock, NULL);
+	pthread_cond_init(&l->event, NULL);
+	snprintf(l->want, sizeof(l->want), "%s", serial);
+	l->index = swd_links_count;
+	l->local = local;
+	l->local_cookie = cookie;
+	l->sock = -1;
+	l->remote = !strncmp(serial, "tcp:", 4) || !strncmp(serial, "unix:", 5);
+	l->sequence = 1;
+	l->maxwords = 512;
+	l->version = 0x0001;
+	dp_state_init(l->dps, 0, 0);
+	l->dp_count = 1;
+	l->dp = l->dps;
+	if (pthread_create(&l->thread, NULL,
+		local ? swd_local : (l->remote ? swd_remote : swd_reader), l)) {
+		free(l->queue);
+		free(l);
+		return NULL;
+	}
+	swd_links[swd_links_count++] = l;
+	return l;
+}
+
+int swdp_open(const char *serial) {
+	return swdp_probe_select(serial);
+}
+
+// probes behind an rswd-server are named by address, so that
+// they can also be picked with swdp_probe_select()
+int swdp_open_remote(const char *addr) {
+	char name[SERIALMAX];
+	if (strncmp(addr, "tcp:", 4) && strncmp(addr, "unix:", 5)) {
+		// a bare host name gets the default rswd-server port
+		snprintf(name, sizeof(name), strchr(addr, ':') ? "tcp:%s" :
+			"tcp:%s:" RSWD_SERVER_PORT, addr);
+		addr = name;
+	}
+	return swdp_probe_select(addr);
+}
+
+int swdp_probe_select(const char *serial) {
+	struct swd_link *l;
+	if (serial == NULL) {
+		serial = "";
+	}
+	if ((l = swdp_link_find(serial)) == NULL) {
+		if ((l = swdp_link_new(serial, NULL, NULL)) == NULL) {
+			return -1;
+		}
+	}
+	swd = l;
 	return 0;
 }
 
-int jtag_io(unsigned count, u32 *tms, u32 *tdi, u32 *tdo) {
-	struct txn t;
-	q_init(&t);
-	if (count > 32768)
+// a capture starts with the version query and reply of each probe,
+// so a replay sees the same firmware limits, and with the AP state
+// forgotten, so the first txns do not depend on what went before
+int swdp_capture_start(const char *path, u32 size) {
+	unsigned n;
+	u32 query[2];
+	if (capture_open(path, size)) {
 		return -1;
-	t.tx[t.txc++] = RSWD_MSG(CMD_JTAG_IO, 0, count);
-	count = (count + 31) / 32;
-	while (count > 0) {
-		t.tx[t.txc++] = *tms++;
-		t.tx[t.txc++] = *tdi++;
-		t.rx[t.rxc++] = tdo++;
-		count--;
 	}
-	return q_exec(&t);
+	for (n = 0; n < swd_links_count; n++) {
+		struct swd_link *l = swd_links[n];
+		pthread_mutex_lock(&l->lock);
+		if ((l->online == 1) && l->query_reply_len) {
+			query[0] = l->query_reply[0];
+			query[1] = RSWD_MSG(CMD_VERSION, 0, RSWD_VERSION);
+			capture_record(CAP_OPEN, l->index, l->serial, strlen(l->serial));
+			capture_record(CAP_TX, l->index, query, sizeof(query));
+			capture_record(CAP_RX, l->index, l->query_reply,
+				l->query_reply_len);
+		}
+		pthread_mutex_unlock(&l->lock);
+	}
+	ap_state_invalidate();
+	return 0;
+}
+
+static int replay_txn(void *cookie, const u32 *tx, unsigned txc,
+	void *reply, unsigned max) {
+	return replay_next(cookie, tx, txc, reply, max);
+}
+
+int swdp_open_replay(const char *path) {
+	capture_replay *rp;
+	struct swd_link *l;
+	if ((rp = replay_open(path)) == NULL) {
+		return -1;
+	}
+	if ((l = swdp_link_new("replay", replay_txn, rp)) == NULL) {
+		return -1;
+	}
+	l->replay = rp;
+	swd = l;
+	return 0;
+}
+
+int swdp_open_sim(void) {
+	struct swd_link *l;
+	if ((l = swdp_link_find("sim")) == NULL) {
+		if ((l = swdp_link_new("sim", sim_txn, NULL)) == NULL) {
+			return -1;
+		}
+	}
+	swd = l;
+	return 0;
+}
+
+static void probe_list_cb(void *cookie, unsigned vid, unsigned pid,
+	const char *serial) {
+	unsigned n;
+	const char *state = "";
+	for (n = 0; n < swd_links_count; n++) {
+		if (serial[0] && !strcmp(swd_links[n]->serial, serial)) {
+			state = (swd_links[n] == swd) ? " (active)" : " (open)";
+			break;
+		}
+	}
+	xprintf(XDATA, "%04x:%04x %s%s\n", vid, pid,
+		serial[0] ? serial : "<no serial>", state);
+}
+
+void swdp_probe_list(void) {
+	unsigned n;
+	usb_enumerate(0x1209, 0x5038, probe_list_cb, NULL);
+	usb_enumerate(0x18d1, 0xdb03, probe_list_cb, NULL);
+	usb_enumerate(0x18d1, 0xdb04, probe_list_cb, NULL);
+	// links still waiting for their probe to show up
+	for (n = 0; n < swd_links_count; n++) {
+		struct swd_link *l = swd_links[n];
+		int waiting;
+		pthread_mutex_lock(&l->lock);
+		waiting = (l->usb == NULL) && (l->sock < 0) && (l->local == NULL);
+		pthread_mutex_unlock(&l->lock);
+		if (l->remote && !waiting) {
+			xprintf(XDATA, "remote    %s%s\n", l->want,
+				(l == swd) ? " (active)" : " (open)");
+		} else if (waiting) {
+			xprintf(XDATA, "          %s (waiting)%s\n",
+				l->want[0] ? l->want : "<any>",
+				(l == swd) ? " (active)" : "");
+		}
+	}
+}
+
+const char *swdp_probe_serial(void) {
+	return swd->serial[0] ? swd->serial : swd->want;
+}
+
+// Scans too long for one txn are split on word boundaries and the
+// pieces pipelined.  The probe just stops TCK between them, so the
+// TAP state carries over from one to the next.
+int jtag_io(unsigned count, u32 *tms, u32 *tdi, u32 *tdo) {
+	struct pipeline p;
+	struct txn *t;
+	unsigned max, n, w;
+
+	// each word of bits is a TMS and TDI word out, a TDO word back
+	max = ((MAXDATAWORDS - 2) / 2) * 32;
+	if (max > 32768)
+		max = 32768;
+	q_pipe_init(&p);
+	// after a failure the TAP state is unknown, so stop there
+	while ((count > 0) && (p.status == 0)) {
+		n = (count > max) ? max : count;
+		t = q_pipe_slot(&p);
+		q_init_raw(t);
+		t->tx[t->txc++] = RSWD_MSG(CMD_JTAG_IO, 0, n);
+		for (w = (n + 31) / 32; w > 0; w--) {
+			t->tx[t->txc++] = *tms++;
+			t->tx[t->txc++] = *tdi++;
+			t->rx[t->rxc++] = tdo++;
+		}
+		q_pipe_submit(&p, t);
+		count -= n;
+	}
+	return q_pipe_finish(&p);
 }
 
 debug_transport SWDP_TRANSPORT = {
@@ -976,5 +2104,8 @@ debug_transport SWDP_TRANSPORT = {
 	.mem_wr_32 = _swdp_ahb_write,
 	.mem_rd_32_c = _swdp_ahb_read32,
 	.mem_wr_32_c = _swdp_ahb_write32,
+	.batch = _swdp_batch,
+	.mem_rd_c = _swdp_mem_rd_c,
+	.mem_wr_c = _swdp_mem_wr_c,
 };
 
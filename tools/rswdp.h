@@ -18,7 +18,23 @@
 #ifndef _RSWDP_H__
 #define _RSWDP_H__
 
-int swdp_open(void);
+/* open a probe by usb serial number (NULL for the first free one)
+ * and make it the active one
+ */
+int swdp_open(const char *serial);
+
+/* open a probe attached to an rswd-server at "[tcp:]host:port" or
+ * "unix:<path>" and make it the active one
+ */
+int swdp_open_remote(const char *addr);
+
+/* switch to another probe, opening it if need be, each probe keeps
+ * its own link state and reader thread (a "tcp:" or "unix:" serial
+ * is the address of an rswd-server)
+ */
+int swdp_probe_select(const char *serial);
+void swdp_probe_list(void);
+const char *swdp_probe_serial(void);
 
 void swdp_enable_tracing(int yes);
 
@@ -26,6 +42,8 @@ void swdp_target_reset(int enable);
 
 int swdp_bootloader(void);
 int swdp_set_clock(unsigned khz);
+/* find the fastest reliable SWCLK, using 1K of target RAM at scratch */
+int swdp_autoclock(u32 scratch, unsigned max_khz);
 int swo_set_clock(unsigned khz);
 
 int jtag_io(unsigned count, u32 *tms, u32 *tdi, u32 *tdo);
@@ -49,13 +67,89 @@ int swdp_core_read(u32 n, u32 *v);
 int swdp_core_read_all(u32 *v);
 int swdp_core_write(u32 n, u32 v);
 
+/* access to a set of CPU registers in one exchange
+ * bit n of mask selects register n, v is indexed by register number
+ */
+int swdp_core_read_regs(u32 mask, u32 *v);
+int swdp_core_write_regs(u32 mask, u32 *v);
+
+/* register cache, valid only while the core stays halted */
+void swdp_core_cache_invalidate(void);
+void swdp_core_cache_stats(unsigned *hits, unsigned *misses, u32 *valid);
+void swdp_core_cache_reset_stats(void);
+/* drop cached registers if a raw write to addr could resume the core */
+void swdp_core_cache_check_write(u32 addr, u32 len, u32 value);
+
 int swdp_watchpoint_pc(unsigned n, u32 addr);
 int swdp_watchpoint_rd(unsigned n, u32 addr);
 int swdp_watchpoint_wr(unsigned n, u32 addr);
 int swdp_watchpoint_rw(unsigned n, u32 addr);
 int swdp_watchpoint_disable(unsigned n);
 
-void swdp_targetsel(u32 val, unsigned on);
+/* select the DP that commands go to, with TARGETSEL val if on
+ * (multi-drop), adding it to the DPs known on this probe if new.
+ * Attached DPs keep their state, so switching back and forth does
+ * not need another attach.
+ */
+int swdp_targetsel(u32 val, unsigned on);
+int swdp_dp_attached(void);
+void swdp_dp_list(void);
+
+/* name of an ERR_* code */
+const char *swd_err_str(unsigned op);
+
+/* link statistics */
+void swdp_stats_dump(void);
+void swdp_stats_reset(void);
+
+/* a responder answers a txn in-process instead of a usb probe,
+ * filling in the reply packet and returning its length in bytes,
+ * or -1 to disconnect
+ */
+typedef int (*swd_local_fn)(void *cookie, const u32 *tx, unsigned txc,
+	void *reply, unsigned max);
+
+/* simulated probe and Cortex-M target (rswd-sim.c) */
+int sim_txn(void *cookie, const u32 *tx, unsigned txc, void *reply, unsigned max);
+void sim_set_latency(unsigned us);
+/* fail every nth SWD transfer with err (ERR_*), 0 to stop */
+void sim_set_errors(unsigned err, unsigned every);
+void sim_set_wrap(u32 size);
+void sim_status(void);
+
+/* use the simulator as the active probe */
+int swdp_open_sim(void);
+
+/* binary capture of all probe traffic to an mmap'd ring file */
+#define CAP_TX		1	/* txn sent to the probe */
+#define CAP_RX		2	/* packet from the probe */
+#define CAP_ERR		3	/* usb link failed */
+#define CAP_OPEN	4	/* probe connected, payload is its serial */
+
+int capture_open(const char *path, u32 size);
+void capture_close(void);
+void capture_record(unsigned type, unsigned link, const void *data, unsigned len);
+void capture_status(void);
+
+/* serve replies from a capture instead of a probe */
+typedef struct capture_replay capture_replay;
+capture_replay *replay_open(const char *path);
+/* copy the reply to tx into reply, returning its length, -1 at the end */
+int replay_next(capture_replay *rp, const u32 *tx, unsigned txc,
+	void *reply, unsigned max);
+void replay_status(capture_replay *rp);
+
+/* start a capture, recording the current state of each probe first */
+int swdp_capture_start(const char *path, u32 size);
+
+/* use a capture file as the active probe */
+int swdp_open_replay(const char *path);
+
+/* TAR auto-increment boundary used to split bulk transfers,
+ * 0 to probe it on each attach (the default)
+ */
+void swdp_set_wrapsize(u32 size);
+u32 swdp_get_wrapsize(void);
 
 /* these are now provided by the transport layer */
 //int swdp_reset(void);
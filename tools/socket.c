@@ -17,9 +17,19 @@
 
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
+#include <netdb.h>
 #include <sys/types.h> 
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <fw/types.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
 
 int socket_listen_tcp(unsigned port) {
 	int fd, n = 1;
@@ -46,3 +56,193 @@ fail:
 	close(fd);
 	return -1;
 }
+
+// Stream sockets for carrying probe traffic: "unix:<path>" for a
+// Unix domain socket, otherwise "[tcp:][host:]port".  TCP sockets
+// have Nagle turned off since every packet is a latency-bound txn.
+
+static int socket_addr(const char *spec, int passive, struct addrinfo **out) {
+	struct addrinfo hints;
+	char host[256];
+	const char *port;
+
+	if (!strncmp(spec, "tcp:", 4)) {
+		spec += 4;
+	}
+	if ((port = strrchr(spec, ':')) == NULL) {
+		port = spec;
+		host[0] = 0;
+	} else {
+		if ((port - spec) >= sizeof(host)) {
+			return -1;
+		}
+		memcpy(host, spec, port - spec);
+		host[port - spec] = 0;
+		port++;
+	}
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (passive) {
+		hints.ai_flags = AI_PASSIVE;
+	}
+	if (getaddrinfo(host[0] ? host : (passive ? NULL : "localhost"),
+		port, &hints, out)) {
+		return -1;
+	}
+	return 0;
+}
+
+static int socket_unix(const char *path, struct sockaddr_un *addr) {
+	if (strlen(path) >= sizeof(addr->sun_path)) {
+		return -1;
+	}
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	strcpy(addr->sun_path, path);
+	return socket(AF_UNIX, SOCK_STREAM, 0);
+}
+
+void socket_nodelay(int fd) {
+	int n = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &n, sizeof(n));
+#ifdef SO_NOSIGPIPE
+	setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &n, sizeof(n));
+#endif
+}
+
+int socket_listen(const char *spec) {
+	struct addrinfo *ai, *a;
+	int fd = -1, n = 1;
+
+	if (!strncmp(spec, "unix:", 5)) {
+		struct sockaddr_un addr;
+		if ((fd = socket_unix(spec + 5, &addr)) < 0) {
+			return -1;
+		}
+		unlink(addr.sun_path);
+		if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+			goto fail;
+		}
+	} else {
+		if (socket_addr(spec, 1, &ai)) {
+			return -1;
+		}
+		for (a = ai; a; a = a->ai_next) {
+			if ((fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol)) < 0) {
+				continue;
+			}
+			setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &n, sizeof(n));
+			if (bind(fd, a->ai_addr, a->ai_addrlen) == 0) {
+				break;
+			}
+			close(fd);
+			fd = -1;
+		}
+		freeaddrinfo(ai);
+		if (fd < 0) {
+			return -1;
+		}
+	}
+	if (listen(fd, 1) < 0) {
+		goto fail;
+	}
+	return fd;
+fail:
+	close(fd);
+	return -1;
+}
+
+int socket_connect(const char *spec) {
+	struct addrinfo *ai, *a;
+	int fd = -1;
+
+	if (!strncmp(spec, "unix:", 5)) {
+		struct sockaddr_un addr;
+		if ((fd = socket_unix(spec + 5, &addr)) < 0) {
+			return -1;
+		}
+		if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+			close(fd);
+			return -1;
+		}
+		socket_nodelay(fd);
+		return fd;
+	}
+	if (socket_addr(spec, 0, &ai)) {
+		return -1;
+	}
+	for (a = ai; a; a = a->ai_next) {
+		if ((fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol)) < 0) {
+			continue;
+		}
+		if (connect(fd, a->ai_addr, a->ai_addrlen) == 0) {
+			socket_nodelay(fd);
+			break;
+		}
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(ai);
+	return fd;
+}
+
+// Packets are framed with a little-endian byte count, sent with
+// their payload in a single write so each goes out as one segment.
+
+int socket_send_frame(int fd, const void *data, unsigned len) {
+	u8 buf[8192 + 4];
+	u8 *p = buf;
+	unsigned n = len + 4;
+
+	if (len > (sizeof(buf) - 4)) {
+		return -1;
+	}
+	buf[0] = len;
+	buf[1] = len >> 8;
+	buf[2] = len >> 16;
+	buf[3] = len >> 24;
+	memcpy(buf + 4, data, len);
+	while (n > 0) {
+		ssize_t r = send(fd, p, n, MSG_NOSIGNAL);
+		if (r <= 0) {
+			if ((r < 0) && (errno == EINTR)) {
+				continue;
+			}
+			return -1;
+		}
+		p += r;
+		n -= r;
+	}
+	return 0;
+}
+
+static int socket_read_all(int fd, void *data, unsigned len) {
+	u8 *p = data;
+	while (len > 0) {
+		ssize_t r = read(fd, p, len);
+		if (r <= 0) {
+			if ((r < 0) && (errno == EINTR)) {
+				continue;
+			}
+			return -1;
+		}
+		p += r;
+		len -= r;
+	}
+	return 0;
+}
+
+// returns the payload length, or -1 on error, eof, or oversize frame
+int socket_recv_frame(int fd, void *data, unsigned max) {
+	u8 hdr[4];
+	unsigned len;
+	if (socket_read_all(fd, hdr, 4)) {
+		return -1;
+	}
+	len = hdr[0] | (hdr[1] << 8) | (hdr[2] << 16) | (hdr[3] << 24);
+	if ((len > max) || socket_read_all(fd, data, len)) {
+		return -1;
+	}
+	return len;
+}
@@ -0,0 +1,35 @@
+/* socket.h
+ *
+ * Copyright 2015 Brian Swetland <swetland@frotz.net>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _SOCKET_H_
+#define _SOCKET_H_
+
+/* listen on a loopback tcp port */
+int socket_listen_tcp(unsigned port);
+
+/* addresses are "unix:<path>" or "[tcp:][host:]port" */
+int socket_listen(const char *spec);
+int socket_connect(const char *spec);
+
+/* disable Nagle (and SIGPIPE where that is a socket option) */
+void socket_nodelay(int fd);
+
+/* length-prefixed packets of at most 8192 bytes */
+int socket_send_frame(int fd, const void *data, unsigned len);
+int socket_recv_frame(int fd, void *data, unsigned max);
+
+#endif
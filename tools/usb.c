@@ -17,34 +17,171 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <pthread.h>
 
 #include <libusb-1.0/libusb.h>
 
 #include "usb.h"
 
+#define USB_RX_MAX 8
+
 struct usb_handle {
 	libusb_device_handle *dev;
 	unsigned ei;
 	unsigned eo;
+
+	/* async state, protected by lock */
+	pthread_mutex_t lock;
+	pthread_cond_t idle;
+	struct libusb_transfer *rx[USB_RX_MAX];
+	unsigned rx_count;
+	unsigned busy;
+	int closing;
+	int failed;
+	usb_rx_cb_t rx_cb;
+	void *rx_cookie;
 };
 
 static libusb_context *usb_ctx = NULL;
+static pthread_t usb_event_thread;
+static pthread_mutex_t usb_event_lock = PTHREAD_MUTEX_INITIALIZER;
+static int usb_event_running = 0;
 
-usb_handle *usb_open(unsigned vid, unsigned pid, unsigned ifc) {
-	usb_handle *usb;
-	int r;
+// a single thread services completions for every async transfer
+static void *usb_event_loop(void *arg) {
+	for (;;) {
+		libusb_handle_events(usb_ctx);
+	}
+	return NULL;
+}
 
+static int usb_init(void) {
 	if (usb_ctx == NULL) {
 		if (libusb_init(&usb_ctx) < 0) {
 			usb_ctx = NULL;
-			return NULL;
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int usb_serial_of(libusb_device_handle *dev, char *buf, int len) {
+	struct libusb_device_descriptor desc;
+	int r;
+	buf[0] = 0;
+	if (libusb_get_device_descriptor(libusb_get_device(dev), &desc) < 0) {
+		return -1;
+	}
+	if (desc.iSerialNumber == 0) {
+		return -1;
+	}
+	r = libusb_get_string_descriptor_ascii(dev, desc.iSerialNumber,
+		(unsigned char*) buf, len);
+	if (r < 0) {
+		buf[0] = 0;
+		return -1;
+	}
+	buf[(r < len) ? r : (len - 1)] = 0;
+	return 0;
+}
+
+int usb_enumerate(unsigned vid, unsigned pid, usb_enum_cb_t cb, void *cookie) {
+	libusb_device **list;
+	libusb_device_handle *dev;
+	struct libusb_device_descriptor desc;
+	char serial[128];
+	ssize_t n, count;
+
+	if (usb_init()) {
+		return -1;
+	}
+	if ((count = libusb_get_device_list(usb_ctx, &list)) < 0) {
+		return -1;
+	}
+	for (n = 0; n < count; n++) {
+		if (libusb_get_device_descriptor(list[n], &desc) < 0) {
+			continue;
+		}
+		if ((desc.idVendor != vid) || (desc.idProduct != pid)) {
+			continue;
+		}
+		serial[0] = 0;
+		if (libusb_open(list[n], &dev) == 0) {
+			usb_serial_of(dev, serial, sizeof(serial));
+			libusb_close(dev);
+		}
+		cb(cookie, vid, pid, serial);
+	}
+	libusb_free_device_list(list, 1);
+	return 0;
+}
+
+// try each matching device in turn, skipping any we cannot
+// claim (most likely because another process is using it)
+static libusb_device_handle *usb_claim(unsigned vid, unsigned pid,
+	unsigned ifc, const char *want) {
+	libusb_device **list;
+	libusb_device_handle *dev = NULL;
+	struct libusb_device_descriptor desc;
+	char serial[128];
+	ssize_t n, count;
+
+	if ((count = libusb_get_device_list(usb_ctx, &list)) < 0) {
+		return NULL;
+	}
+	for (n = 0; n < count; n++) {
+		if (libusb_get_device_descriptor(list[n], &desc) < 0) {
+			continue;
+		}
+		if ((desc.idVendor != vid) || (desc.idProduct != pid)) {
+			continue;
 		}
+		if (libusb_open(list[n], &dev)) {
+			dev = NULL;
+			continue;
+		}
+		if (want && want[0]) {
+			usb_serial_of(dev, serial, sizeof(serial));
+			if (strcmp(serial, want)) {
+				goto next;
+			}
+		}
+		// This causes problems on re-attach.  Maybe need for OSX?
+		// On Linux it's completely happy without us explicitly setting a configuration.
+		//r = libusb_set_configuration(dev, 1);
+		if (libusb_claim_interface(dev, ifc) == 0) {
+			break;
+		}
+		if (want && want[0]) {
+			fprintf(stderr, "failed to claim interface #%d\n", ifc);
+		}
+next:
+		libusb_close(dev);
+		dev = NULL;
+	}
+	libusb_free_device_list(list, 1);
+	return dev;
+}
+
+usb_handle *usb_open(unsigned vid, unsigned pid, unsigned ifc) {
+	return usb_open_serial(vid, pid, ifc, NULL);
+}
+
+usb_handle *usb_open_serial(unsigned vid, unsigned pid, unsigned ifc,
+	const char *serial) {
+	usb_handle *usb;
+
+	if (usb_init()) {
+		return NULL;
 	}
 
-	usb = malloc(sizeof(usb_handle));
+	usb = calloc(1, sizeof(usb_handle));
 	if (usb == 0) {
 		return NULL;
 	}
+	pthread_mutex_init(&usb->lock, NULL);
+	pthread_cond_init(&usb->idle, NULL);
 
 	/* TODO: extract from descriptors */
 	switch (ifc) {
@@ -60,18 +197,10 @@ usb_handle *usb_open(unsigned vid, unsigned pid, unsigned ifc) {
 		goto fail;
 	}
 
-	usb->dev = libusb_open_device_with_vid_pid(usb_ctx, vid, pid);
+	usb->dev = usb_claim(vid, pid, ifc, serial);
 	if (usb->dev == NULL) {
 		goto fail;
 	}
-	// This causes problems on re-attach.  Maybe need for OSX?
-	// On Linux it's completely happy without us explicitly setting a configuration.
-	//r = libusb_set_configuration(usb->dev, 1);
-	r = libusb_claim_interface(usb->dev, ifc);
-	if (r < 0) {
-		fprintf(stderr, "failed to claim interface #%d\n", ifc);
-		goto close_fail;
-	}
 
 #ifdef __APPLE__
 	// make sure everyone's data toggles agree
@@ -82,15 +211,32 @@ usb_handle *usb_open(unsigned vid, unsigned pid, unsigned ifc) {
 
 	return usb;
 
-close_fail:
-	libusb_close(usb->dev);
 fail:
 	free(usb);
 	return NULL;
 }
 
 void usb_close(usb_handle *usb) {
+	unsigned n;
+
+	// cancel posted transfers and wait for their callbacks to finish
+	pthread_mutex_lock(&usb->lock);
+	usb->closing = 1;
+	for (n = 0; n < usb->rx_count; n++) {
+		libusb_cancel_transfer(usb->rx[n]);
+	}
+	while (usb->busy > 0) {
+		pthread_cond_wait(&usb->idle, &usb->lock);
+	}
+	pthread_mutex_unlock(&usb->lock);
+
+	for (n = 0; n < usb->rx_count; n++) {
+		free(usb->rx[n]->buffer);
+		libusb_free_transfer(usb->rx[n]);
+	}
 	libusb_close(usb->dev);
+	pthread_cond_destroy(&usb->idle);
+	pthread_mutex_destroy(&usb->lock);
 	free(usb);
 }
 
@@ -104,6 +250,10 @@ int usb_ctrl(usb_handle *usb, void *data,
 	}
 }
 
+int usb_get_serial(usb_handle *usb, char *buf, int len) {
+	return usb_serial_of(usb->dev, buf, len);
+}
+
 int usb_read(usb_handle *usb, void *data, int len) {
 	int xfer = len;
 	int r = libusb_bulk_transfer(usb->dev, usb->ei, data, len, &xfer, 5000);
@@ -131,3 +281,134 @@ int usb_write(usb_handle *usb, const void *data, int len) {
 	return xfer;
 }
 
+
+// called with usb->lock held, reports the first failure only
+static void usb_async_fail(usb_handle *usb) {
+	if (usb->failed || usb->closing) {
+		return;
+	}
+	usb->failed = 1;
+	pthread_mutex_unlock(&usb->lock);
+	usb->rx_cb(usb->rx_cookie, NULL, -1);
+	pthread_mutex_lock(&usb->lock);
+}
+
+// called with usb->lock held
+static void usb_async_done(usb_handle *usb) {
+	if (--usb->busy == 0) {
+		pthread_cond_broadcast(&usb->idle);
+	}
+}
+
+static void usb_rx_complete(struct libusb_transfer *xfer) {
+	usb_handle *usb = xfer->user_data;
+
+	if (xfer->status == LIBUSB_TRANSFER_COMPLETED) {
+		usb->rx_cb(usb->rx_cookie, xfer->buffer, xfer->actual_length);
+		pthread_mutex_lock(&usb->lock);
+		if (!usb->closing && !usb->failed) {
+			// repost immediately so the device always has somewhere to write
+			if (libusb_submit_transfer(xfer) == 0) {
+				pthread_mutex_unlock(&usb->lock);
+				return;
+			}
+			usb_async_fail(usb);
+		}
+	} else {
+		pthread_mutex_lock(&usb->lock);
+		if (xfer->status != LIBUSB_TRANSFER_CANCELLED) {
+			usb_async_fail(usb);
+		}
+	}
+	usb_async_done(usb);
+	pthread_mutex_unlock(&usb->lock);
+}
+
+static void usb_tx_complete(struct libusb_transfer *xfer) {
+	usb_handle *usb = xfer->user_data;
+
+	pthread_mutex_lock(&usb->lock);
+	if ((xfer->status != LIBUSB_TRANSFER_COMPLETED) ||
+		(xfer->actual_length != xfer->length)) {
+		usb_async_fail(usb);
+	}
+	free(xfer->buffer);
+	libusb_free_transfer(xfer);
+	usb_async_done(usb);
+	pthread_mutex_unlock(&usb->lock);
+}
+
+int usb_start_rx(usb_handle *usb, unsigned count, int len,
+	usb_rx_cb_t cb, void *cookie) {
+	struct libusb_transfer *xfer;
+	void *buf;
+
+	if (count > USB_RX_MAX) {
+		count = USB_RX_MAX;
+	}
+	// links may be opened from different threads
+	pthread_mutex_lock(&usb_event_lock);
+	if (!usb_event_running) {
+		if (pthread_create(&usb_event_thread, NULL, usb_event_loop, NULL)) {
+			pthread_mutex_unlock(&usb_event_lock);
+			return -1;
+		}
+		pthread_detach(usb_event_thread);
+		usb_event_running = 1;
+	}
+	pthread_mutex_unlock(&usb_event_lock);
+
+	pthread_mutex_lock(&usb->lock);
+	usb->rx_cb = cb;
+	usb->rx_cookie = cookie;
+	while (usb->rx_count < count) {
+		if ((xfer = libusb_alloc_transfer(0)) == NULL) {
+			goto fail;
+		}
+		if ((buf = malloc(len)) == NULL) {
+			libusb_free_transfer(xfer);
+			goto fail;
+		}
+		libusb_fill_bulk_transfer(xfer, usb->dev, usb->ei, buf, len,
+			usb_rx_complete, usb, 0);
+		if (libusb_submit_transfer(xfer)) {
+			free(buf);
+			libusb_free_transfer(xfer);
+			goto fail;
+		}
+		usb->rx[usb->rx_count++] = xfer;
+		usb->busy++;
+	}
+	pthread_mutex_unlock(&usb->lock);
+	return 0;
+fail:
+	pthread_mutex_unlock(&usb->lock);
+	return -1;
+}
+
+int usb_queue_write(usb_handle *usb, const void *data, int len) {
+	struct libusb_transfer *xfer;
+	void *buf;
+
+	if ((xfer = libusb_alloc_transfer(0)) == NULL) {
+		return -1;
+	}
+	if ((buf = malloc(len)) == NULL) {
+		libusb_free_transfer(xfer);
+		return -1;
+	}
+	memcpy(buf, data, len);
+	libusb_fill_bulk_transfer(xfer, usb->dev, usb->eo, buf, len,
+		usb_tx_complete, usb, 5000);
+
+	pthread_mutex_lock(&usb->lock);
+	if (usb->closing || usb->failed || libusb_submit_transfer(xfer)) {
+		pthread_mutex_unlock(&usb->lock);
+		free(buf);
+		libusb_free_transfer(xfer);
+		return -1;
+	}
+	usb->busy++;
+	pthread_mutex_unlock(&usb->lock);
+	return len;
+}
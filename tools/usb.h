@@ -25,10 +25,34 @@ typedef struct usb_handle usb_handle;
 /* simple usb api for devices with bulk in+out interfaces */
 
 usb_handle *usb_open(unsigned vid, unsigned pid, unsigned ifc);
+// like usb_open, but only a device with a matching serial number
+// (any device if serial is NULL or empty)
+usb_handle *usb_open_serial(unsigned vid, unsigned pid, unsigned ifc,
+	const char *serial);
 void usb_close(usb_handle *usb);
 int usb_read(usb_handle *usb, void *data, int len);
 int usb_read_forever(usb_handle *usb, void *data, int len);
 int usb_write(usb_handle *usb, const void *data, int len);
 int usb_ctrl(usb_handle *usb, void *data,
 	uint8_t typ, uint8_t req, uint16_t val, uint16_t idx, uint16_t len);
+// copy the device serial number string into buf, "" if none
+int usb_get_serial(usb_handle *usb, char *buf, int len);
+
+// call cb for each attached device with this vid:pid
+typedef void (*usb_enum_cb_t)(void *cookie, unsigned vid, unsigned pid,
+	const char *serial);
+int usb_enumerate(unsigned vid, unsigned pid, usb_enum_cb_t cb, void *cookie);
+
+/* async api: a pool of bulk in transfers stays posted and each
+ * completed packet is handed to the callback (from the usb event
+ * thread) before it is reposted.  A failure of any transfer is
+ * reported exactly once as a callback with len < 0.
+ * usb_queue_write() copies the data and returns without waiting.
+ * usb_close() must not be called from the callback.
+ */
+typedef void (*usb_rx_cb_t)(void *cookie, void *data, int len);
+
+int usb_start_rx(usb_handle *usb, unsigned count, int len,
+	usb_rx_cb_t cb, void *cookie);
+int usb_queue_write(usb_handle *usb, const void *data, int len);
 #endif